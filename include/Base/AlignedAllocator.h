@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "Base/Definitions.h"
+
+// Allocates memory aligned to Alignment bytes and rounded up to whole cache lines.
+// With the default page alignment the memory can be wrapped by a CL_MEM_USE_HOST_PTR buffer without a copy (zero copy) on CPU devices and integrated GPUs.
+template<typename T, size_t Alignment = mpp::constants::ZERO_COPY_ALIGNMENT>
+class AlignedAllocator
+{
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(size_t count)
+    {
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+        size_t size = (count * sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+        return static_cast<T*>(::operator new(size, std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* pointer, size_t) noexcept
+    {
+        ::operator delete(pointer, std::align_val_t(Alignment));
+    }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) noexcept
+{
+    return true;
+}
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) noexcept
+{
+    return false;
+}
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -8,14 +8,36 @@ namespace mpp
     {
         static constexpr char KERNELS_PREFIX_SUM[] = "kernel_prefix_sum.cl";
         static constexpr char KERNELS_HASHTABLE[] = "kernel_hashtable.cl";
+        static constexpr char KERNELS_STREAM_COMPACTION[] = "kernel_stream_compaction.cl";
+        static constexpr char KERNELS_RADIX_SORT[] = "kernel_radix_sort.cl";
+        static constexpr char KERNELS_HISTOGRAM[] = "kernel_histogram.cl";
     };
 
     namespace kernels
     {
         static constexpr char PREFIX_SUM[] = "PrefixSum256";
         static constexpr char PREFIX_CALC_E[] = "CalcE";
+        static constexpr char PREFIX_SUM_SINGLE_PASS[] = "PrefixSumSinglePass";
+        static constexpr char PREFIX_SUM_BATCHED[] = "PrefixSumBatched";
+        static constexpr char PREFIX_SUM_SEGMENTED[] = "SegmentedPrefixSum256";
+        static constexpr char PREFIX_CALC_E_SEGMENTED[] = "SegmentedCalcE";
+        static constexpr char PREFIX_SEGMENT_HEAD_FLAGS[] = "SegmentHeadFlags";
+        static constexpr char REDUCE[] = "Reduce";
+        static constexpr char ARG_REDUCE[] = "ArgReduce";
+
+        static constexpr char COMPACT_FLAGS[] = "CompactFlags";
+        static constexpr char COMPACT_SCATTER[] = "CompactScatter";
+
+        static constexpr char RADIX_HISTOGRAM[] = "RadixHistogram";
+        static constexpr char RADIX_SCATTER[] = "RadixScatter";
+
+        static constexpr char HISTOGRAM[] = "Histogram";
 
         static constexpr char HASHTABLE_INSERT[] = "Insert";
+        static constexpr char HASHTABLE_REINSERT[] = "Reinsert";
+        static constexpr char HASHTABLE_PARTITION[] = "Partition";
+        static constexpr char HASHTABLE_PARTITION_SCATTER[] = "PartitionScatter";
+        static constexpr char HASHTABLE_BUILD_PARTITIONS[] = "BuildPartitions";
         static constexpr char HASHTABLE_RETRIEVE[] = "Retrieve";
     };
 
@@ -24,6 +46,7 @@ namespace mpp
         static constexpr size_t MAX_THREADS_PER_CU = 256;   // Just an assumption for academic purposes. Real value depends on device!
         static constexpr std::array<cl_int, MAX_THREADS_PER_CU> ZEROS = std::array<cl_int, MAX_THREADS_PER_CU>();
         static constexpr size_t WAVEFRONT_SIZE = 32;
+        static constexpr size_t ZERO_COPY_ALIGNMENT = 4096; // Host memory wrapped with CL_MEM_USE_HOST_PTR has to be page aligned to avoid copies
         static constexpr uint64_t EMPTY = -1;
         static constexpr uint32_t EMPTY_32 = -1;
     };
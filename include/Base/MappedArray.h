@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Maps a whole file into the address space (CreateFileMapping/MapViewOfFile on Windows, mmap elsewhere).
+// The pages are loaded on first access, so large files don't have to be read into heap memory up front.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps an existing file read only
+    bool Open(const std::string& file_name);
+    // Creates (or truncates) a file of num_bytes bytes and maps it writable
+    bool Create(const std::string& file_name, size_t num_bytes);
+    void Close();
+
+    bool IsOpen() const { return data_ != nullptr; }
+    void* GetData() const { return data_; }
+    size_t GetSize() const { return size_; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* mapping_handle_ = nullptr;
+#else
+    int file_descriptor_ = -1;
+#endif
+};
+
+// Typed view of a mapped binary file of T, e.g. a column file. The mapping is page aligned,
+// so it can be wrapped by CL_MEM_USE_HOST_PTR buffers (zero copy) or streamed in chunks without another host copy.
+template<typename T>
+class MappedArray
+{
+public:
+    bool Open(const std::string& file_name)
+    {
+        return file_.Open(file_name);
+    }
+
+    bool Create(const std::string& file_name, size_t num_elements)
+    {
+        return file_.Create(file_name, num_elements * sizeof(T));
+    }
+
+    void Close()
+    {
+        file_.Close();
+    }
+
+    bool IsOpen() const { return file_.IsOpen(); }
+
+    T* data() { return static_cast<T*>(file_.GetData()); }
+    const T* data() const { return static_cast<const T*>(file_.GetData()); }
+    size_t size() const { return file_.GetSize() / sizeof(T); }
+    bool empty() const { return size() == 0; }
+
+    T* begin() { return data(); }
+    T* end() { return data() + size(); }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+
+    T& operator[](size_t index) { return data()[index]; }
+    const T& operator[](size_t index) const { return data()[index]; }
+
+private:
+    MappedFile file_;
+};
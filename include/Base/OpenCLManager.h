@@ -1,5 +1,6 @@
 #pragma once
 #include <CL/cl.h>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
@@ -13,16 +14,36 @@ public:
     cl_command_queue command_queue = 0;
     cl_program program = 0;
 
+    // Set during initialization: true if the device has sub group scans (cl_khr_subgroups, cl_intel_subgroups or OpenCL 2.1/2.2 core).
+    // subgroup_build_options holds the options kernels using them have to be built with, e.g. "-cl-std=CL2.0".
+    bool subgroups_supported = false;
+    std::string subgroup_build_options;
+
     void LoadKernel(const std::string& file_name, std::initializer_list<std::string> kernel_names);
 
+    // Returns a kernel of file_name compiled with the given build options (e.g. "-DELEMENTS_PER_ITEM=4").
+    // source_prefix is prepended to the file content, e.g. a user defined function the kernels call.
+    // Every file/options/prefix combination is built only once per process.
+    cl_kernel GetKernel(const std::string& file_name, const std::string& kernel_name, const std::string& build_options = "", const std::string& source_prefix = "");
+
     std::unordered_map<std::string, cl_kernel> kernel_map;
 
+    // The cached kernels are shared, so threads enqueueing concurrently (e.g. PrefixScan::CalculateGPUAsync) hold this lock
+    // while they set kernel arguments and enqueue
+    std::mutex enqueue_mutex;
+
 private:
     OpenCLManager();
     ~OpenCLManager();
     
     void Init();
+    void DetectSubgroupSupport();
+    std::string GetDeviceInfoString(cl_device_info param_name) const;
+    cl_program BuildProgram(const std::string& file_name, const std::string& build_options, const std::string& source_prefix = "");
 
     static OpenCLManager* instance_;
     cl_device_id device_id_ = 0;
+
+    std::unordered_map<std::string, cl_program> program_cache_;   // key: file name + build options + source prefix
+    std::unordered_map<std::string, cl_kernel> kernel_cache_;     // key: file name + build options + source prefix + kernel name
 };
@@ -3,10 +3,20 @@
 #include <cstdint>
 #include <CL\cl.h>
 #include "Base/Definitions.h"
+#include "PrefixSum/Histogram.h"
+#include "PrefixSum/StreamCompaction.h"
 
 class HashTable
 {
 public:
+    enum class Layout
+    {
+        FourHashFunctions,  // One entry per slot, four hash functions. A miss reads four random entries.
+        Buckets,            // Buckets of bucket_size entries, two hash functions. A lookup reads at most two buckets.
+        Partitioned         // Two levels: the keys are partitioned into groups of at most 512 keys, every work group builds the
+                            // three cuckoo sub-tables of its partition in local memory. A lookup reads at most three entries of one partition.
+    };
+
     HashTable();
     ~HashTable();
 
@@ -15,23 +25,90 @@ public:
     bool Insert(const std::vector<uint32_t>& keys, const std::vector<uint32_t>& values);
     std::vector<uint32_t> Retrieve(const std::vector<uint32_t>& keys);
 
+    // Same for keys and values in any host memory, e.g. a MappedArray of a column file. The keys are uploaded straight from there.
+    bool Init(uint32_t table_size, const uint32_t* keys, const uint32_t* values, size_t num_keys);
+    bool Insert(const uint32_t* keys, const uint32_t* values, size_t num_keys);
+    void Retrieve(const uint32_t* keys, size_t num_keys, uint32_t* values);
+
+    // Number of reconstructions the last Init with keys needed
+    uint32_t GetNumReconstructions() const { return current_iteration_; }
+    // Number of entries the last recovery pass re-inserted
+    size_t GetNumRetriedEntries() const { return num_retried_entries_; }
+    // Number of entries in the stash, reads the stash back from the device
+    uint32_t GetNumStashedEntries();
+
     uint32_t max_iterations = 8;
     uint32_t max_reconstructions = 3;
     float table_size_factor = 1.25f;
 
+    // Incremental recovery: the entries left over by a failed insertion are compacted on the device and re-inserted
+    // with max_retry_iterations evictions. The table is only rebuilt if this second pass fails as well.
+    bool retry_failed_keys = false;
+    uint32_t max_retry_iterations = 64;
+
+    // Entries whose eviction chain exceeds max_iterations go into a small stash behind the table instead of failing the insertion.
+    // Retrieve checks the stash last.
+    bool use_stash = false;
+
+    // The bucketized layout allows smaller table_size_factors, e.g. 1.1 for a load factor of 0.9.
+    // With 8 entries of 8 bytes every bucket is one 64 byte cache line.
+    Layout layout = Layout::FourHashFunctions;
+    uint32_t bucket_size = 8;   // 4 or 8
+
+    // Evictions of the two-level build stay in local memory, so its eviction chains may be much longer than max_iterations
+    uint32_t max_partition_iterations = 64;
+
 private:
+    // Allocates the table, the parameters and the status buffer, all are kept for later reconstructions
+    void Allocate(uint32_t table_size);
+    // Fills the table with empty elements and writes new hash parameters on the device. Returns two events.
+    void Reset(cl_event* reset_events);
     void GenerateParams();
+    // Uploads keys and values padded to the wavefront size, returns the padded number of keys
+    size_t Upload(const uint32_t* keys, const uint32_t* values, size_t num_keys, cl_mem& keys_buffer, cl_mem& values_buffer);
+    // Inserts keys and values already on the device. Only the status is read back.
+    bool Insert(cl_mem keys_buffer, cl_mem values_buffer, size_t num_padded_keys, cl_uint num_wait_events, const cl_event* wait_events);
+    // Two-level build of keys and values already on the device: partition (histogram, scan, scatter), then one work group per partition
+    bool BuildPartitioned(cl_mem keys_buffer, cl_mem values_buffer, size_t num_keys, cl_uint num_wait_events, const cl_event* wait_events);
+    // Compacts the failed entries of the last insertion and re-inserts them. Only their number and the status are read back.
+    bool Reinsert(size_t num_padded_keys);
+    void ReserveEntries(size_t num_padded_keys);
+    void ReservePartitions(size_t num_keys, uint32_t num_partitions);
 
     cl_mem table_buffer_ = 0;
     cl_mem params_buffer_ = 0;
+    cl_mem status_buffer_ = 0;
+    uint32_t table_capacity_ = 0;
+
+    // Entries left over by Insert and their compacted copy for the recovery pass
+    StreamCompaction<cl_ulong> compaction_;
+    cl_mem failed_entries_buffer_ = 0;
+    cl_mem retry_entries_buffer_ = 0;
+    size_t entries_capacity_ = 0;
+    size_t num_retried_entries_ = 0;
+
+    // Partition of every key, keys per partition, partition offsets and fill cursors and the entries grouped by partition of the two-level build
+    Histogram histogram_;
+    PrefixScan<cl_uint> partition_scan_;
+    cl_mem partitions_buffer_ = 0;
+    cl_mem partition_counts_buffer_ = 0;
+    cl_mem partition_offsets_buffer_ = 0;
+    cl_mem partition_cursors_buffer_ = 0;
+    cl_mem partition_entries_buffer_ = 0;
+    size_t partition_keys_capacity_ = 0;
+    uint32_t partitions_capacity_ = 0;
     uint32_t current_iteration_ = 0;
     const uint32_t THREAD_BLOCK_SIZE = 64;
+    const uint32_t STASH_SIZE = 101;
+    // Two-level layout, the sizes are the same as in kernel_hashtable.cl
+    const uint32_t PARTITION_AVERAGE_KEYS = 409;
+    const uint32_t PARTITION_SLOTS = 576;
 
     // parameters
     uint32_t size_ = 0;
     uint32_t random_seed_ = 42;
 
-    const uint32_t NUM_PARAMS = 10;
+    const uint32_t NUM_PARAMS = 15;
     size_t PARAM_IDX_HASHFUNC_A_0 = 0;
     size_t PARAM_IDX_HASHFUNC_B_0 = 1;
     size_t PARAM_IDX_HASHFUNC_A_1 = 2;
@@ -42,5 +119,10 @@ private:
     size_t PARAM_IDX_HASHFUNC_B_3 = 7;
     size_t PARAM_IDX_MAX_ITERATIONS = 8;
     size_t PARAM_IDX_TABLESIZE = 9;
+    size_t PARAM_IDX_HASHFUNC_A_STASH = 10;
+    size_t PARAM_IDX_HASHFUNC_B_STASH = 11;
+    size_t PARAM_IDX_STASH_SIZE = 12;
+    size_t PARAM_IDX_BUCKET_SIZE = 13;
+    size_t PARAM_IDX_PARTITIONED = 14;
     std::vector<uint32_t> params_ = std::vector<uint32_t>(NUM_PARAMS, 0);
 };
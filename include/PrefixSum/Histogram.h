@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <CL\cl.h>
+#include "PrefixSum/PrefixSum.h"
+
+// Histogram of 32 bit keys on the device, the bin of a key is (key >> shift) % num_bins.
+// Every work group counts in local memory and merges its bins into the global histogram with one atomic per bin.
+// More bins than fit into local memory are counted range by range (range bucketing), a work group per range and input slice.
+// CalculateOffsets() scans the histogram on the device, which gives the start of every partition in one call.
+class Histogram
+{
+public:
+    Histogram() = default;
+    Histogram(size_t max_num_elements, uint32_t max_num_bins);
+    ~Histogram();
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void Reserve(size_t max_num_elements, uint32_t max_num_bins);
+
+    // Returns the number of keys per bin
+    std::vector<cl_uint> Calculate(const std::vector<cl_uint>& keys, uint32_t num_bins);
+    // Returns the exclusive scan of the histogram, i.e. the first position of every bin's partition
+    std::vector<cl_uint> CalculateOffsets(const std::vector<cl_uint>& keys, uint32_t num_bins);
+
+    // Counts num_elements keys of keys_buffer into histogram_buffer (num_bins elements, zeroed here) after wait_event (0: no dependency).
+    // Returns the event of the histogram kernel, the caller releases it.
+    cl_event Calculate(cl_mem keys_buffer, size_t num_elements, uint32_t num_bins, cl_mem histogram_buffer, cl_event wait_event = 0);
+
+    static std::vector<cl_uint> CalculateCPU(const std::vector<cl_uint>& keys, uint32_t num_bins, uint32_t shift = 0);
+
+    // Right shift of the keys before the modulo, e.g. to histogram the upper bits of radix partitions
+    uint32_t shift = 0;
+
+private:
+    void Release();
+    // Uploads the keys and counts them into histogram_buffer_
+    cl_event Upload(const std::vector<cl_uint>& keys, uint32_t num_bins);
+
+    static constexpr size_t WORK_GROUP_SIZE = 256;
+    static constexpr size_t ELEMENTS_PER_ITEM = 16;
+    static constexpr size_t MAX_NUM_GROUPS = 256;
+    static constexpr uint32_t LOCAL_BINS = 4096;
+
+    PrefixScan<cl_uint> scan_;
+    size_t capacity_ = 0;
+    uint32_t bins_capacity_ = 0;
+    cl_mem keys_buffer_ = 0;
+    cl_mem histogram_buffer_ = 0;
+    cl_mem offsets_buffer_ = 0;
+};
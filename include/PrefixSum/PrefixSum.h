@@ -1,13 +1,230 @@
 #pragma once
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <string>
+#include <type_traits>
 #include <vector>
 #include <CL\cl.h>
+#include "Base/AlignedAllocator.h"
+#include "Base/Definitions.h"
 
-class PrefixSum
+// Element types of the scan and their names on the device
+template<typename T> struct ScanType;
+template<> struct ScanType<cl_int>    { static constexpr char NAME[] = "int";    static constexpr char LOWEST[] = "INT_MIN";   static constexpr char HIGHEST[] = "INT_MAX"; };
+template<> struct ScanType<cl_uint>   { static constexpr char NAME[] = "uint";   static constexpr char LOWEST[] = "0";         static constexpr char HIGHEST[] = "UINT_MAX"; };
+template<> struct ScanType<cl_long>   { static constexpr char NAME[] = "long";   static constexpr char LOWEST[] = "LONG_MIN";  static constexpr char HIGHEST[] = "LONG_MAX"; };
+template<> struct ScanType<cl_ulong>  { static constexpr char NAME[] = "ulong";  static constexpr char LOWEST[] = "0";         static constexpr char HIGHEST[] = "ULONG_MAX"; };
+template<> struct ScanType<cl_float>  { static constexpr char NAME[] = "float";  static constexpr char LOWEST[] = "-INFINITY"; static constexpr char HIGHEST[] = "INFINITY"; };
+template<> struct ScanType<cl_double> { static constexpr char NAME[] = "double"; static constexpr char LOWEST[] = "-INFINITY"; static constexpr char HIGHEST[] = "INFINITY"; };
+
+// Scan operators. NAME selects the operator of the device code (OP_SUM, OP_MAX, OP_MIN in kernel_prefix_sum.cl).
+namespace scan_op
+{
+    struct Sum
+    {
+        static constexpr char NAME[] = "OP_SUM";
+
+        template<typename T> static T Identity()
+        {
+            return T(0);
+        }
+
+        template<typename T> static T Apply(T a, T b)
+        {
+            // Integer sums wrap around like on the device
+            if constexpr (std::is_integral_v<T>)
+            {
+                using U = std::make_unsigned_t<T>;
+                return static_cast<T>(static_cast<U>(a) + static_cast<U>(b));
+            }
+            else
+            {
+                return a + b;
+            }
+        }
+    };
+
+    struct Max
+    {
+        static constexpr char NAME[] = "OP_MAX";
+
+        template<typename T> static T Identity()
+        {
+            return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+        }
+
+        template<typename T> static T Apply(T a, T b)
+        {
+            return std::max(a, b);
+        }
+    };
+
+    struct Min
+    {
+        static constexpr char NAME[] = "OP_MIN";
+
+        template<typename T> static T Identity()
+        {
+            return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+        }
+
+        template<typename T> static T Apply(T a, T b)
+        {
+            return std::min(a, b);
+        }
+    };
+};
+
+// Exclusive scan of elements of type T with the associative operator Op.
+// Instantiated for cl_int, cl_uint, cl_long, cl_ulong, cl_float and cl_double with scan_op::Sum, scan_op::Max and scan_op::Min.
+template<typename T, typename Op = scan_op::Sum>
+class PrefixScan
 {
 public:
-    static std::vector<cl_int> CalculateCPU(const std::vector<cl_int>& elements);
-    static std::vector<cl_int> CalculateGPU(const std::vector<cl_int>& elements);
-   
+    enum class Algorithm
+    {
+        Recursive,  // Blelloch scan per sub array, recursion over the sub array sums (PrefixSum256 + CalcE)
+        SinglePass  // One launch with decoupled look-back between the sub arrays (PrefixSumSinglePass)
+    };
+
+    enum class ScanMode
+    {
+        Exclusive,  // result[i] = carry_in op elements[0] op ... op elements[i - 1]
+        Inclusive   // result[i] = carry_in op elements[0] op ... op elements[i]
+    };
+
+    PrefixScan() = default;
+    explicit PrefixScan(size_t max_num_elements);
+    ~PrefixScan();
+
+    PrefixScan(const PrefixScan&) = delete;
+    PrefixScan& operator=(const PrefixScan&) = delete;
+
+    // Allocates the device buffers of every recursion level once, so scans of up to max_num_elements elements don't allocate anymore.
+    void Reserve(size_t max_num_elements);
+    std::vector<T> Calculate(const std::vector<T>& elements);
+
+    // Zero copy scan: elements and result are wrapped by CL_MEM_USE_HOST_PTR buffers, the result is synchronized with a map instead of a read.
+    // result is resized to the number of elements.
+    void Calculate(const AlignedVector<T>& elements, AlignedVector<T>& result);
+
+    // Same for any host memory, e.g. a MappedArray of a file. Without a copy only if both pointers are page aligned.
+    void Calculate(const T* elements, T* result, size_t num_elements);
+
+    // Enqueues upload, scan and download of num_elements elements after wait_event (0: no dependency) and returns the event of the download.
+    // Nothing blocks, elements and result have to stay valid until the event completed. Reserve() has to be called up front.
+    cl_event Enqueue(const T* elements, T* result, size_t num_elements, cl_event wait_event = 0);
+
+    // Enqueues the scan of device buffer A into device buffer B after wait_event and returns the event of its last command.
+    // For primitives built on the scan whose data stays on the device. Reserve() has to cover num_elements.
+    // Every scan of an instance, synchronous or asynchronous, waits for the previous one, they share buffer C & D and the tile buffers.
+    cl_event CalculateGPU(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event);
+
+    // Scans every array of a packed batch independently in one launch, one work group per array. array_offsets holds the first element
+    // of every array (CSR row offsets), mode, reverse, carry_in and the transforms apply to every array. Meant for many small arrays:
+    // no sub array sums, no recursion and a single upload and download for the whole batch.
+    std::vector<T> CalculateBatch(const std::vector<T>& elements, const std::vector<cl_uint>& array_offsets);
+
+    // Same on device buffers after wait_event (0: no dependency). offsets_buffer holds num_arrays + 1 entries, the last one is the total number of elements.
+    cl_event CalculateBatchGPU(cl_mem a_buffer, cl_mem b_buffer, cl_mem offsets_buffer, size_t num_arrays, cl_event wait_event = 0);
+
+    // Enqueues upload, scan and download and returns at once, the future becomes ready when the download completed.
+    // Every call gets its own buffer A & B, so producer threads can prepare and enqueue the next batch while the previous ones are in flight.
+    // Calls on the same instance share the sub array buffers, so their scans run one after another on the device.
+    // Only the asynchronous calls may be made from several threads at once, Reserve() and the synchronous calls are not thread safe.
+    std::future<std::vector<T>> CalculateGPUAsync(std::vector<T> elements);
+
+    // Same for device resident buffers: enqueues the scan of a_buffer into b_buffer after wait_event (0: no dependency) and returns its event,
+    // the caller releases it. The result stays on the device for further commands.
+    cl_event CalculateGPUAsync(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event = 0);
+
+    static std::vector<T> CalculateCPU(const std::vector<T>& elements, ScanMode mode = ScanMode::Exclusive, bool reverse = false,
+        T carry_in = Op::template Identity<T>());
+    static std::vector<T> CalculateGPU(const std::vector<T>& elements, Algorithm algorithm = Algorithm::Recursive);
+
+    // Host scan on num_threads threads (0: std::thread::hardware_concurrency). Every thread reduces its block, the block sums are scanned
+    // and every thread scans its block again starting at its block prefix. 32 bit integer sums scan the blocks with SSE2/AVX2.
+    static std::vector<T> CalculateCPUParallel(const std::vector<T>& elements, size_t num_threads = 0, ScanMode mode = ScanMode::Exclusive,
+        T carry_in = Op::template Identity<T>());
+
+    // Build options selecting T and Op in kernel_prefix_sum.cl
+    static std::string GetTypeBuildOptions();
+
+    Algorithm algorithm = Algorithm::Recursive;
+
+    // Applied by the kernels while writing the result. reverse scans from the last to the first element.
+    // carry_in is combined with every result, e.g. the total of the previous chunk of a chunked scan.
+    ScanMode mode = ScanMode::Exclusive;
+    bool reverse = false;
+    T carry_in = Op::template Identity<T>();
+
+    // OpenCL C expressions of the element x of type T, fused into the top level kernels so map, scan and map run without intermediate buffers.
+    // load_transform is applied to every input element before the scan (e.g. "x > 0 ? 1 : 0"), store_transform to every result
+    // after carry_in (e.g. "x * 4"). Empty means no transform. Every combination is compiled once.
+    std::string load_transform;
+    std::string store_transform;
+
+    // Work items per work group and elements each work item scans sequentially in private memory before the work group scan.
+    // Both are passed to the kernels as build options, one tile holds work_group_size * elements_per_work_item elements.
+    // work_group_size has to be a power of two.
+    size_t work_group_size = mpp::constants::MAX_THREADS_PER_CU;
+    size_t elements_per_work_item = 1;
+
+    // Pads the local scan array with CONFLICT_FREE_OFFSET to avoid local memory bank conflicts in the up/down sweep
+    bool conflict_free_offsets = false;
+
+    // Scans within a work group with sub group scans if OpenCLManager reports sub group support, otherwise falls back to the Blelloch scan
+    bool use_subgroups = true;
+
+    // Allocates buffer A & B with CL_MEM_ALLOC_HOST_PTR and fills/reads them with map/unmap instead of write/read.
+    // Avoids the staging copies of CPU devices and integrated GPUs, on discrete GPUs it's usually slower.
+    bool zero_copy = false;
+
+    // Reads back and checks the sums of every recursion level. Blocks the host at each level, so it's off by default.
+    bool debug_validation = false;
+
 private:
-    static void CalculateGPU_Recursive(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements);
+    // Buffers C & D of one recursion level
+    struct Level
+    {
+        cl_mem c_buffer = 0;
+        cl_mem d_buffer = 0;
+    };
+
+    // Enqueues the scan of one level after wait_event and returns the event of its last command
+    cl_event CalculateGPU_Recursive(size_t level, cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event);
+    void ValidateSubArraySums(cl_mem c_buffer, cl_mem d_buffer, size_t num_sub_arrays, cl_event wait_event);
+    cl_event CalculateGPU_SinglePass(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event);
+    // Scan after wait_event and the previous scan of this instance. The caller holds OpenCLManager::enqueue_mutex.
+    cl_event EnqueueScan(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event);
+    void Release();
+
+    size_t GetTileSize() const;
+    // Options of the top level kernels include scan mode and direction, the sub array sums are always scanned exclusively and forward
+    std::string GetBuildOptions(bool top_level) const;
+    // Definitions of load_transform and store_transform in front of the top level kernels
+    std::string GetSourcePrefix(bool top_level) const;
+
+    size_t capacity_ = 0;
+    size_t reserved_tile_size_ = 0;
+    bool reserved_zero_copy_ = false;
+    cl_mem input_buffer_ = 0;   // Buffer A
+    cl_mem result_buffer_ = 0;  // Buffer B
+    std::vector<Level> levels_;
+
+    // Look-back state of the single pass scan, one entry per tile
+    cl_mem tile_status_buffer_ = 0;
+    cl_mem tile_aggregates_buffer_ = 0;
+    cl_mem tile_prefixes_buffer_ = 0;
+    cl_mem tile_counter_buffer_ = 0;
+
+    // Last scan of this instance, the next one waits for it before it reuses buffer C & D and the tile buffers
+    cl_event last_scan_event_ = 0;
+
+    // Offsets of the arrays of CalculateBatch()
+    cl_mem batch_offsets_buffer_ = 0;
+    size_t batch_offsets_capacity_ = 0;
 };
+
+using PrefixSum = PrefixScan<cl_int, scan_op::Sum>;
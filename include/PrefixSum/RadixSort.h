@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <CL\cl.h>
+#include "PrefixSum/PrefixSum.h"
+
+// LSD radix sort of 32 bit keys on the device, one pass per digit of radix_bits bits:
+// 1. a histogram kernel counts the digits of every tile
+// 2. the histograms are scanned with PrefixScan, which gives the output start of every digit of every tile
+// 3. a scatter kernel sorts every tile by the digit in local memory and writes it stably to these starts
+// Works with plain work group barriers and local atomics only, so it runs on CPU OpenCL devices as well.
+class RadixSort
+{
+public:
+    RadixSort() = default;
+    explicit RadixSort(size_t max_num_elements);
+    ~RadixSort();
+
+    RadixSort(const RadixSort&) = delete;
+    RadixSort& operator=(const RadixSort&) = delete;
+
+    void Reserve(size_t max_num_elements);
+
+    // Sorts the keys ascending
+    void Sort(std::vector<cl_uint>& keys);
+    // Sorts the keys ascending and moves every value with its key. Equal keys keep their order.
+    void Sort(std::vector<cl_uint>& keys, std::vector<cl_uint>& values);
+
+    // Sorts num_elements keys (and values, 0: key only) of device buffers in place after wait_event (0: no dependency).
+    // Returns the event of the last pass, the caller releases it.
+    cl_event Sort(cl_mem keys_buffer, cl_mem values_buffer, size_t num_elements, cl_event wait_event = 0);
+
+    // Stable reference on the host
+    static void SortCPU(std::vector<cl_uint>& keys, std::vector<cl_uint>& values);
+
+    // Bits per digit, 4 (8 passes) or 8 (4 passes). 8 bit digits need fewer passes but larger histograms.
+    uint32_t radix_bits = 4;
+
+private:
+    void Release();
+
+    static constexpr size_t WORK_GROUP_SIZE = 256;
+    static constexpr size_t ELEMENTS_PER_ITEM = 4;
+    static constexpr size_t TILE_SIZE = WORK_GROUP_SIZE * ELEMENTS_PER_ITEM;
+    static constexpr uint32_t MAX_RADIX_BITS = 8;
+
+    PrefixScan<cl_uint> scan_;
+    size_t capacity_ = 0;
+    cl_mem keys_buffer_ = 0;
+    cl_mem values_buffer_ = 0;
+    cl_mem temp_keys_buffer_ = 0;
+    cl_mem temp_values_buffer_ = 0;
+    cl_mem histograms_buffer_ = 0;
+    cl_mem offsets_buffer_ = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <CL\cl.h>
+#include "PrefixSum/PrefixSum.h"
+
+// Reduction of elements of type T with the operator Op to a single value, for when only the total of a scan is needed.
+// Two launches of the Reduce kernel (kernel_prefix_sum.cl, same element types and operators as PrefixScan): a fixed number of work groups
+// reduce grid strides of the input to partial results, one work group reduces those. Only the result is read back.
+// With scan_op::Max and scan_op::Min CalculateIndex() returns the argmax/argmin.
+template<typename T, typename Op = scan_op::Sum>
+class Reduction
+{
+public:
+    Reduction() = default;
+    explicit Reduction(size_t max_num_elements);
+    ~Reduction();
+
+    Reduction(const Reduction&) = delete;
+    Reduction& operator=(const Reduction&) = delete;
+
+    // Allocates the upload buffer of the host overloads, the device buffer overloads only need the fixed size partial results
+    void Reserve(size_t max_num_elements);
+
+    // Returns the identity of Op for no elements
+    T Calculate(const std::vector<T>& elements);
+    // Index of the first element equal to the maximum (scan_op::Max) or minimum (scan_op::Min), elements must not be empty
+    size_t CalculateIndex(const std::vector<T>& elements);
+
+    // Reduces num_elements (> 0) elements of input_buffer into result_buffer[0] after wait_event (0: no dependency).
+    // Returns the event of the last launch, the caller releases it.
+    cl_event Calculate(cl_mem input_buffer, size_t num_elements, cl_mem result_buffer, cl_event wait_event = 0);
+    // Same for the argmax/argmin, the index goes to index_buffer[0]
+    cl_event CalculateIndex(cl_mem input_buffer, size_t num_elements, cl_mem result_buffer, cl_mem index_buffer, cl_event wait_event = 0);
+
+    static T CalculateCPU(const std::vector<T>& elements);
+    static size_t CalculateIndexCPU(const std::vector<T>& elements);
+
+private:
+    void Release();
+    // Allocates the partial results, the result and the index buffer once, their size doesn't depend on the number of elements
+    void AllocatePartials();
+    // Uploads the elements into input_buffer_ and returns the event of the write
+    cl_event Upload(const std::vector<T>& elements);
+    size_t GetNumGroups(size_t num_elements) const;
+
+    static constexpr size_t WORK_GROUP_SIZE = mpp::constants::MAX_THREADS_PER_CU;
+    static constexpr size_t ELEMENTS_PER_ITEM = 16;
+    // The second launch reduces at most one partial result per work item
+    static constexpr size_t MAX_NUM_GROUPS = WORK_GROUP_SIZE;
+
+    size_t capacity_ = 0;
+    cl_mem input_buffer_ = 0;
+    cl_mem partials_buffer_ = 0;
+    cl_mem partial_indices_buffer_ = 0;
+    cl_mem result_buffer_ = 0;
+    cl_mem index_buffer_ = 0;
+};
+
+using SumReduction = Reduction<cl_int, scan_op::Sum>;
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <CL\cl.h>
+#include "PrefixSum/PrefixSum.h"
+
+// Scan of many independent segments in one launch sequence. A segment starts at every element with a set head flag (and at element 0),
+// the scan restarts at the identity there. Same recursion as PrefixScan, the sub array sums carry a flag if a segment starts in the sub array.
+template<typename T, typename Op = scan_op::Sum>
+class SegmentedPrefixScan
+{
+public:
+    using ScanMode = typename PrefixScan<T, Op>::ScanMode;
+
+    SegmentedPrefixScan() = default;
+    explicit SegmentedPrefixScan(size_t max_num_elements);
+    ~SegmentedPrefixScan();
+
+    SegmentedPrefixScan(const SegmentedPrefixScan&) = delete;
+    SegmentedPrefixScan& operator=(const SegmentedPrefixScan&) = delete;
+
+    void Reserve(size_t max_num_elements);
+
+    // head_flags[i] != 0 starts a new segment at element i
+    std::vector<T> Calculate(const std::vector<T>& elements, const std::vector<cl_uint>& head_flags);
+
+    // segment_offsets holds the index of the first element of every segment (CSR row offsets). The head flags are set on the device.
+    std::vector<T> CalculateByOffsets(const std::vector<T>& elements, const std::vector<cl_uint>& segment_offsets);
+
+    static std::vector<T> CalculateCPU(const std::vector<T>& elements, const std::vector<cl_uint>& head_flags, ScanMode mode = ScanMode::Exclusive);
+    static std::vector<cl_uint> OffsetsToHeadFlags(const std::vector<cl_uint>& segment_offsets, size_t num_elements);
+
+    ScanMode mode = ScanMode::Exclusive;
+
+    // See PrefixScan
+    size_t work_group_size = mpp::constants::MAX_THREADS_PER_CU;
+    size_t elements_per_work_item = 1;
+
+private:
+    // Buffers C & D of one recursion level with the flags of their elements
+    struct Level
+    {
+        cl_mem c_buffer = 0;
+        cl_mem fc_buffer = 0;
+        cl_mem d_buffer = 0;
+        cl_mem fd_buffer = 0;
+    };
+
+    // Runs the scan on the elements in buffer A and the flags in buffer FA after wait_event
+    std::vector<T> Calculate(size_t num_elements, cl_event wait_event);
+
+    // Enqueues the scan of one level after wait_event and returns the event of its last command
+    cl_event CalculateGPU_Recursive(size_t level, cl_mem a_buffer, cl_mem fa_buffer, cl_mem b_buffer, cl_mem fb_buffer, size_t num_elements, cl_event wait_event);
+    void Release();
+
+    size_t GetTileSize() const;
+    std::string GetBuildOptions() const;
+
+    size_t capacity_ = 0;
+    size_t reserved_tile_size_ = 0;
+    cl_mem input_buffer_ = 0;           // Buffer A
+    cl_mem input_flags_buffer_ = 0;     // Buffer FA
+    cl_mem result_buffer_ = 0;          // Buffer B
+    cl_mem result_flags_buffer_ = 0;    // Buffer FB
+    cl_mem offsets_buffer_ = 0;
+    size_t offsets_capacity_ = 0;
+    std::vector<Level> levels_;
+};
+
+using SegmentedPrefixSum = SegmentedPrefixScan<cl_int, scan_op::Sum>;
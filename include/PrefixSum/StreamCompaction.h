@@ -0,0 +1,44 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <CL\cl.h>
+#include "PrefixSum/PrefixSum.h"
+
+// Filter on the device: a flag kernel evaluates the predicate, the flags are scanned to the output positions and a scatter kernel
+// writes the surviving elements. All three stages run on device buffers, only the survivors are read back.
+// Instantiated for the element types of PrefixScan.
+template<typename T>
+class StreamCompaction
+{
+public:
+    StreamCompaction() = default;
+    explicit StreamCompaction(size_t max_num_elements);
+    ~StreamCompaction();
+
+    StreamCompaction(const StreamCompaction&) = delete;
+    StreamCompaction& operator=(const StreamCompaction&) = delete;
+
+    void Reserve(size_t max_num_elements);
+
+    // predicate is an OpenCL C expression of the element x, e.g. "x > 0" or "(x & 1) == 0".
+    // Every predicate is compiled once. Returns the surviving elements in their original order.
+    std::vector<T> Compact(const std::vector<T>& elements, const std::string& predicate);
+
+    // Compacts num_elements elements of input_buffer into output_buffer after wait_event (0: no dependency) and returns the number of survivors.
+    // output_buffer has to hold num_elements elements. Only the count is read back.
+    size_t Compact(cl_mem input_buffer, size_t num_elements, const std::string& predicate, cl_mem output_buffer, cl_event wait_event = 0);
+
+    static std::vector<T> CompactCPU(const std::vector<T>& elements, const std::function<bool(T)>& predicate);
+
+private:
+    void Release();
+
+    PrefixScan<cl_uint> scan_;
+    size_t capacity_ = 0;
+    cl_mem input_buffer_ = 0;
+    cl_mem output_buffer_ = 0;
+    cl_mem flags_buffer_ = 0;
+    cl_mem positions_buffer_ = 0;
+    cl_mem count_buffer_ = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <CL\cl.h>
+#include "Base/AlignedAllocator.h"
+#include "PrefixSum/PrefixSum.h"
+
+// Scan of inputs larger than the device memory. The input is scanned in chunks of chunk_size elements, two chunks are in flight at once:
+// while the device uploads, scans and downloads one chunk, the host reads the next chunk and writes the result of the previous one.
+// The running total of the previous chunks is the carry_in of the next one, so the kernels combine it with every result and the host only
+// reads it from the end of the previous chunk before enqueuing the next one.
+// Device memory stays at two PrefixScan instances of chunk_size elements regardless of the length of the input.
+template<typename T, typename Op = scan_op::Sum>
+class StreamingPrefixScan
+{
+public:
+    using ScanMode = typename PrefixScan<T, Op>::ScanMode;
+
+    // Fills buffer with up to max_count elements and returns the number of elements read, 0 ends the input
+    using ChunkReader = std::function<size_t(T* buffer, size_t max_count)>;
+    // Receives the next count results
+    using ChunkWriter = std::function<void(const T* results, size_t count)>;
+
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 22;
+
+    explicit StreamingPrefixScan(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    ~StreamingPrefixScan();
+
+    StreamingPrefixScan(const StreamingPrefixScan&) = delete;
+    StreamingPrefixScan& operator=(const StreamingPrefixScan&) = delete;
+
+    // Scans everything read_chunk returns and returns the total, i.e. carry_in combined with all elements
+    T Calculate(const ChunkReader& read_chunk, const ChunkWriter& write_chunk);
+
+    // Scans [first, last) into result and returns the end of the written range
+    template<typename InputIt, typename OutputIt>
+    OutputIt Calculate(InputIt first, InputIt last, OutputIt result)
+    {
+        Calculate(
+            [&first, &last](T* buffer, size_t max_count)
+            {
+                size_t count = 0;
+                for (; count < max_count && first != last; ++count, ++first)
+                {
+                    buffer[count] = *first;
+                }
+                return count;
+            },
+            [&result](const T* results, size_t count)
+            {
+                result = std::copy(results, results + count, result);
+            });
+
+        return result;
+    }
+
+    // Scans a binary file of T into another binary file of T
+    T CalculateFile(const std::string& input_file_name, const std::string& output_file_name);
+
+    size_t GetChunkSize() const;
+
+    ScanMode mode = ScanMode::Exclusive;
+    T carry_in = Op::template Identity<T>();
+
+private:
+    static constexpr size_t NUM_SLOTS = 2;
+
+    // One chunk in flight: its own scan buffers on the device and its host input/result
+    struct Slot
+    {
+        PrefixScan<T, Op> scan;
+        AlignedVector<T> input;
+        AlignedVector<T> result;
+        size_t count = 0;
+        cl_event event = 0;
+    };
+
+    // Waits for the download of the slot and takes the running total from the end of its results
+    void Finish(Slot& slot, T& total);
+
+    size_t chunk_size_ = 0;
+    std::array<Slot, NUM_SLOTS> slots_;
+};
+
+using StreamingPrefixSum = StreamingPrefixScan<cl_int, scan_op::Sum>;
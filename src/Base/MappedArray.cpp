@@ -0,0 +1,204 @@
+#include "Base/MappedArray.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& file_name)
+{
+    Close();
+
+    file_handle_ = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_handle_ == INVALID_HANDLE_VALUE)
+    {
+        file_handle_ = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle_, &file_size) || file_size.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    // 1. Map the whole file read only
+    mapping_handle_ = CreateFileMappingA(file_handle_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle_ == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    if (data_ == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MappedFile::Create(const std::string& file_name, size_t num_bytes)
+{
+    Close();
+
+    if (num_bytes == 0)
+    {
+        return false;
+    }
+
+    file_handle_ = CreateFileA(file_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle_ == INVALID_HANDLE_VALUE)
+    {
+        file_handle_ = nullptr;
+        return false;
+    }
+
+    // 1. The mapping grows the file to its size
+    LARGE_INTEGER file_size;
+    file_size.QuadPart = static_cast<LONGLONG>(num_bytes);
+    mapping_handle_ = CreateFileMappingA(file_handle_, NULL, PAGE_READWRITE, file_size.HighPart, file_size.LowPart, NULL);
+    if (mapping_handle_ == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = MapViewOfFile(mapping_handle_, FILE_MAP_WRITE, 0, 0, 0);
+    size_ = num_bytes;
+    if (data_ == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data_ != nullptr)
+    {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+
+    if (mapping_handle_ != nullptr)
+    {
+        CloseHandle(mapping_handle_);
+        mapping_handle_ = nullptr;
+    }
+
+    if (file_handle_ != nullptr)
+    {
+        CloseHandle(file_handle_);
+        file_handle_ = nullptr;
+    }
+
+    size_ = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& file_name)
+{
+    Close();
+
+    file_descriptor_ = open(file_name.c_str(), O_RDONLY);
+    if (file_descriptor_ < 0)
+    {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor_, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    // 1. Map the whole file read only, the input is usually read front to back
+    void* data = mmap(NULL, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, file_descriptor_, 0);
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = data;
+    size_ = static_cast<size_t>(file_stat.st_size);
+    madvise(data_, size_, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+bool MappedFile::Create(const std::string& file_name, size_t num_bytes)
+{
+    Close();
+
+    if (num_bytes == 0)
+    {
+        return false;
+    }
+
+    file_descriptor_ = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor_ < 0)
+    {
+        return false;
+    }
+
+    // 1. Grow the file to its size, then map it writable
+    if (ftruncate(file_descriptor_, static_cast<off_t>(num_bytes)) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* data = mmap(NULL, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = data;
+    size_ = num_bytes;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data_ != nullptr)
+    {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+
+    if (file_descriptor_ >= 0)
+    {
+        close(file_descriptor_);
+        file_descriptor_ = -1;
+    }
+
+    size_ = 0;
+}
+
+#endif
@@ -19,10 +19,15 @@ OpenCLManager::~OpenCLManager()
         clReleaseKernel(kernel);
     }
 
+    for (auto& [kernel_key, kernel] : kernel_cache_)
+    {
+        clReleaseKernel(kernel);
+    }
+
     // Release cl objects
-    if (program != 0)
+    for (auto& [program_key, cached_program] : program_cache_)
     {
-        clReleaseProgram(program);
+        clReleaseProgram(cached_program);
     }
 
     if (command_queue != 0)
@@ -56,37 +61,79 @@ void OpenCLManager::LoadKernel(const std::string& file_name, std::initializer_li
 {
     cl_int status = 0;
 
+    program = BuildProgram(file_name, "");
+
+    // Create kernel objects
+    for (auto& kernel_name : kernel_names)
+    {
+        cl_kernel kernel = clCreateKernel(program, kernel_name.c_str(), &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        auto it = kernel_map.find(kernel_name);
+        if (it != kernel_map.end())
+        {
+            clReleaseKernel(it->second);
+        }
+
+        kernel_map[kernel_name] = kernel;
+    }
+}
+
+cl_kernel OpenCLManager::GetKernel(const std::string& file_name, const std::string& kernel_name, const std::string& build_options, const std::string& source_prefix)
+{
+    std::string kernel_key = file_name + "|" + build_options + "|" + source_prefix + "|" + kernel_name;
+    auto it = kernel_cache_.find(kernel_key);
+    if (it != kernel_cache_.end())
+    {
+        return it->second;
+    }
+
+    cl_int status = 0;
+    cl_kernel kernel = clCreateKernel(BuildProgram(file_name, build_options, source_prefix), kernel_name.c_str(), &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    kernel_cache_[kernel_key] = kernel;
+    return kernel;
+}
+
+cl_program OpenCLManager::BuildProgram(const std::string& file_name, const std::string& build_options, const std::string& source_prefix)
+{
+    std::string program_key = file_name + "|" + build_options + "|" + source_prefix;
+    auto it = program_cache_.find(program_key);
+    if (it != program_cache_.end())
+    {
+        return it->second;
+    }
+
+    cl_int status = 0;
+
     // Read file content
     auto [return_code, file_content] = Utility::ReadFile("src/kernels/" + file_name);
     assert(return_code == mpp::ReturnCode::CODE_SUCCESS);
 
-    // Create program
-    const char* program_source = file_content.c_str();
-    size_t source_length = strlen(file_content.c_str());
-    program = clCreateProgramWithSource(context, 1, &program_source, &source_length, &status);
+    // Create program, the prefix goes in front of the file content
+    const char* program_sources[2] = { source_prefix.c_str(), file_content.c_str() };
+    size_t source_lengths[2] = { source_prefix.size(), strlen(file_content.c_str()) };
+    cl_program new_program = source_prefix.empty()
+        ? clCreateProgramWithSource(context, 1, &program_sources[1], &source_lengths[1], &status)
+        : clCreateProgramWithSource(context, 2, program_sources, source_lengths, &status);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
     // Compile program
-    status = clBuildProgram(program, 1, &device_id_, NULL, NULL, NULL);
+    status = clBuildProgram(new_program, 1, &device_id_, build_options.c_str(), NULL, NULL);
 
     // Check compilation status log
     if (status != mpp::ReturnCode::CODE_SUCCESS)
     {
         char msg[120000];
-        clGetProgramBuildInfo(program, device_id_, CL_PROGRAM_BUILD_LOG, sizeof(msg), msg, NULL);
+        clGetProgramBuildInfo(new_program, device_id_, CL_PROGRAM_BUILD_LOG, sizeof(msg), msg, NULL);
         std::cerr << "=== build failed ===\n" << msg << std::endl;
         getc(stdin);
     }
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // Create kernel objects
-    for (auto& kernel_name : kernel_names)
-    {
-        cl_kernel kernel = clCreateKernel(program, kernel_name.c_str(), &status);
-        assert(status == mpp::ReturnCode::CODE_SUCCESS);
-
-        kernel_map[kernel_name] = kernel;
-    }
+    program_cache_[program_key] = new_program;
+    return new_program;
 }
 
 void OpenCLManager::Init()
@@ -111,7 +158,7 @@ void OpenCLManager::Init()
     cl_device_id* devices = nullptr;
     cl_device_type chosen_device_type = CL_DEVICE_TYPE_GPU;
     status = clGetDeviceIDs(platform, chosen_device_type, 0, nullptr, &num_devices);
-    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS || status == CL_DEVICE_NOT_FOUND);   // CPU-only platforms like pocl report CL_DEVICE_NOT_FOUND
 
     if (num_devices == 0)	// no GPU available
     {
@@ -135,4 +182,44 @@ void OpenCLManager::Init()
 
     command_queue = clCreateCommandQueue(context, device_id_, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE, &status);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    DetectSubgroupSupport();
+}
+
+void OpenCLManager::DetectSubgroupSupport()
+{
+    std::string extensions = " " + GetDeviceInfoString(CL_DEVICE_EXTENSIONS) + " ";
+    std::string device_version = GetDeviceInfoString(CL_DEVICE_VERSION);            // "OpenCL <major>.<minor> <vendor specific>"
+    std::string c_version = GetDeviceInfoString(CL_DEVICE_OPENCL_C_VERSION);         // "OpenCL C <major>.<minor> <vendor specific>"
+
+    bool has_khr_subgroups = extensions.find(" cl_khr_subgroups ") != std::string::npos;
+    bool has_intel_subgroups = extensions.find(" cl_intel_subgroups ") != std::string::npos;
+    bool has_core_subgroups = device_version.rfind("OpenCL 2.1", 0) == 0 || device_version.rfind("OpenCL 2.2", 0) == 0;
+    subgroups_supported = has_khr_subgroups || has_intel_subgroups || has_core_subgroups;
+
+    // The sub group built-ins of cl_khr_subgroups and of OpenCL 2.x are only declared for OpenCL C 2.0 and later
+    subgroup_build_options.clear();
+    if (subgroups_supported && c_version.size() >= 12 && c_version.rfind("OpenCL C ", 0) == 0 && c_version[9] >= '2')
+    {
+        subgroup_build_options = "-cl-std=CL" + c_version.substr(9, 3);
+    }
+}
+
+std::string OpenCLManager::GetDeviceInfoString(cl_device_info param_name) const
+{
+    size_t info_size = 0;
+    cl_int status = clGetDeviceInfo(device_id_, param_name, 0, nullptr, &info_size);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    std::string info(info_size, '\0');
+    status = clGetDeviceInfo(device_id_, param_name, info_size, &info[0], nullptr);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Strip the terminating null character
+    while (!info.empty() && info.back() == '\0')
+    {
+        info.pop_back();
+    }
+
+    return info;
 }
@@ -4,6 +4,8 @@
 #include "Base\Definitions.h"
 #include "Base\Utilities.h"
 
+#include <algorithm>
+
 HashTable::HashTable()
 {
     // Init random seed
@@ -25,95 +27,254 @@ HashTable::~HashTable()
         status = clReleaseMemObject(params_buffer_);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
     }
+
+    for (cl_mem buffer : { status_buffer_, failed_entries_buffer_, retry_entries_buffer_, partitions_buffer_, partition_counts_buffer_,
+        partition_offsets_buffer_, partition_cursors_buffer_, partition_entries_buffer_ })
+    {
+        if (buffer != 0)
+        {
+            status = clReleaseMemObject(buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+    }
 }
 
 bool HashTable::Init(uint32_t table_size)
 {
-    size_ = static_cast<uint32_t>(ceil(table_size * table_size_factor));
-    GenerateParams();
+    Allocate(table_size);
 
-    OpenCLManager* mgr = OpenCLManager::GetInstance();
-    assert(mgr != nullptr);
-    cl_int status = 0;
+    // 1. Initialize all the memory with empty elements and generate new hash parameters
+    cl_event reset_events[2] = { 0, 0 };
+    Reset(reset_events);
 
-    // 1. Allocate enough memory on GPU to fit hash table
-    if(table_buffer_ == 0)
+    cl_int status = clWaitForEvents(2, reset_events);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    for (cl_event reset_event : reset_events)
     {
-        table_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, size_ * sizeof(uint64_t), NULL, NULL);
+        cl_int release_status = clReleaseEvent(reset_event);
+        assert(release_status == mpp::ReturnCode::CODE_SUCCESS);
     }
 
-    // 2. Initialize all the memory with empty elements
-    std::vector<uint64_t> empty_elements(size_, mpp::constants::EMPTY);
-    status = clEnqueueWriteBuffer(mgr->command_queue, table_buffer_, CL_TRUE, 0, size_ * sizeof(uint64_t), empty_elements.data(), 0, NULL, NULL);
-    assert(status == mpp::ReturnCode::CODE_SUCCESS);
-
     return status == mpp::ReturnCode::CODE_SUCCESS;
 }
 
 bool HashTable::Init(uint32_t table_size, const std::vector<uint32_t>& keys, const std::vector<uint32_t>& values)
 {
-    bool success = true;
+    assert(keys.size() == values.size());
+    return Init(table_size, keys.data(), values.data(), keys.size());
+}
+
+bool HashTable::Init(uint32_t table_size, const uint32_t* keys, const uint32_t* values, size_t num_keys)
+{
+    current_iteration_ = 0;
+    num_retried_entries_ = 0;
+    if (num_keys == 0)
+    {
+        return Init(table_size);
+    }
+
+    cl_int status = 0;
+
+    // 1. Upload keys and values once, they stay on the device for all reconstructions
+    cl_mem keys_buffer = 0;
+    cl_mem values_buffer = 0;
+    size_t num_padded_keys = Upload(keys, values, num_keys, keys_buffer, values_buffer);
+    Allocate(table_size);
+
+    bool success = false;
     for(current_iteration_ = 0; current_iteration_ < max_reconstructions; ++current_iteration_)
     {
-        Init(table_size);
+        // 2. Reset the table on the device, only the hash parameters are written by the host
+        cl_event reset_events[2] = { 0, 0 };
+        Reset(reset_events);
 
-        if(keys.size() > 0)
+        // 3. Relaunch the insertion, only the status is read back
+        if (layout == Layout::Partitioned)
         {
-            success = Insert(keys, values);
+            success = BuildPartitioned(keys_buffer, values_buffer, num_keys, 2, reset_events);
+        }
+        else
+        {
+            success = Insert(keys_buffer, values_buffer, num_padded_keys, 2, reset_events);
+        }
 
-            if(success)
-            {
-                break;
-            }
+        for (cl_event reset_event : reset_events)
+        {
+            status = clReleaseEvent(reset_event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        if(success)
+        {
+            break;
         }
     }
 
+    // 4. Cleanup -> Release buffers
+    status = clReleaseMemObject(keys_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseMemObject(values_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
     return success;
 }
 
 bool HashTable::Insert(const std::vector<uint32_t>& keys, const std::vector<uint32_t>& values)
 {
     assert(keys.size() == values.size());
+    return Insert(keys.data(), values.data(), keys.size());
+}
+
+bool HashTable::Insert(const uint32_t* keys, const uint32_t* values, size_t num_keys)
+{
+    // The two-level layout is built from all keys at once by Init
+    assert(layout != Layout::Partitioned);
+    cl_int status = 0;
+
+    cl_mem keys_buffer = 0;
+    cl_mem values_buffer = 0;
+    size_t num_padded_keys = Upload(keys, values, num_keys, keys_buffer, values_buffer);
+
+    bool success = Insert(keys_buffer, values_buffer, num_padded_keys, 0, NULL);
+
+    status = clReleaseMemObject(keys_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseMemObject(values_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return success;
+}
+
+void HashTable::Allocate(uint32_t table_size)
+{
+    size_ = static_cast<uint32_t>(ceil(table_size * table_size_factor));
+    if (layout == Layout::Buckets)
+    {
+        // Whole buckets only
+        assert(bucket_size == 4 || bucket_size == 8);
+        size_ = Utility::GetNextMultipleOf(size_, bucket_size);
+    }
+    else if (layout == Layout::Partitioned)
+    {
+        // The partitions hold PARTITION_AVERAGE_KEYS keys on average, this gives the load factor instead of table_size_factor
+        uint32_t num_partitions = std::max(1u, (table_size + PARTITION_AVERAGE_KEYS - 1) / PARTITION_AVERAGE_KEYS);
+        size_ = num_partitions * PARTITION_SLOTS;
+    }
 
     OpenCLManager* mgr = OpenCLManager::GetInstance();
     assert(mgr != nullptr);
     cl_int status = 0;
 
+    // 1. Allocate enough memory on GPU to fit hash table and the stash behind it, a smaller table reuses the buffer
+    if (table_buffer_ == 0 || size_ > table_capacity_)
+    {
+        if (table_buffer_ != 0)
+        {
+            status = clReleaseMemObject(table_buffer_);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        table_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, (size_ + STASH_SIZE) * sizeof(uint64_t), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        table_capacity_ = size_;
+    }
+
+    // 2. The parameters and the status buffer are overwritten by every reconstruction
+    if (params_buffer_ == 0)
+    {
+        params_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, params_.size() * sizeof(uint32_t), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, sizeof(uint32_t), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+}
+
+void HashTable::Reset(cl_event* reset_events)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // 1. Fill the table and the stash with empty elements without a host copy
+    const uint64_t empty_element = mpp::constants::EMPTY;
+    status = clEnqueueFillBuffer(mgr->command_queue, table_buffer_, &empty_element, sizeof(uint64_t), 0, (size_ + STASH_SIZE) * sizeof(uint64_t), 0, NULL, &reset_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 2. Write new hash parameters. params_ is not touched again before the insertion waiting for this write is done.
+    GenerateParams();
+    status = clEnqueueWriteBuffer(mgr->command_queue, params_buffer_, CL_FALSE, 0, params_.size() * sizeof(uint32_t), params_.data(), 0, NULL, &reset_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+}
+
+size_t HashTable::Upload(const uint32_t* keys, const uint32_t* values, size_t num_keys, cl_mem& keys_buffer, cl_mem& values_buffer)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
     // 1. Allocate GPU memory for key-val-pairs to insert, padded to size of wavefront
-    cl_int next_multiple = static_cast<cl_int>(
-        Utility::GetNextMultipleOf(static_cast<uint32_t>(keys.size()), static_cast<uint32_t>(mpp::constants::WAVEFRONT_SIZE)));
+    size_t next_multiple = Utility::GetNextMultipleOf(static_cast<uint32_t>(num_keys), static_cast<uint32_t>(mpp::constants::WAVEFRONT_SIZE));
 
-    cl_mem keys_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(uint32_t), NULL, NULL);
-    cl_mem values_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, next_multiple * sizeof(uint32_t), NULL, NULL);
+    keys_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, next_multiple * sizeof(uint32_t), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    values_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, next_multiple * sizeof(uint32_t), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
     // 2. Fill buffers
-    status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer, CL_TRUE, 0, keys.size() * sizeof(uint32_t), keys.data(), 0, NULL, NULL);
+    status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer, CL_TRUE, 0, num_keys * sizeof(uint32_t), keys, 0, NULL, NULL);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clEnqueueWriteBuffer(mgr->command_queue, values_buffer, CL_TRUE, 0, values.size() * sizeof(uint32_t), values.data(), 0, NULL, NULL);
+    status = clEnqueueWriteBuffer(mgr->command_queue, values_buffer, CL_TRUE, 0, num_keys * sizeof(uint32_t), values, 0, NULL, NULL);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
     // If necessary write padding
-    if (keys.size() < next_multiple)
+    if (num_keys < next_multiple)
     {
-        uint32_t num_padded_elements = next_multiple - static_cast<uint32_t>(keys.size());
-        std::vector<uint32_t> empty_elements(num_padded_elements, mpp::constants::EMPTY_32);
-        size_t offset = keys.size() * sizeof(uint32_t);
-        size_t num_bytes_written = num_padded_elements * sizeof(uint32_t);
-        status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer, CL_TRUE, offset, num_bytes_written, empty_elements.data(), 0, NULL, NULL);
+        const uint32_t empty_element = mpp::constants::EMPTY_32;
+        size_t offset = num_keys * sizeof(uint32_t);
+        size_t num_bytes_written = (next_multiple - num_keys) * sizeof(uint32_t);
+        cl_event padding_events[2] = { 0, 0 };
+        status = clEnqueueFillBuffer(mgr->command_queue, keys_buffer, &empty_element, sizeof(uint32_t), offset, num_bytes_written, 0, NULL, &padding_events[0]);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
-        status = clEnqueueWriteBuffer(mgr->command_queue, values_buffer, CL_TRUE, offset, num_bytes_written, empty_elements.data(), 0, NULL, NULL);
+        status = clEnqueueFillBuffer(mgr->command_queue, values_buffer, &empty_element, sizeof(uint32_t), offset, num_bytes_written, 0, NULL, &padding_events[1]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        status = clWaitForEvents(2, padding_events);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        for (cl_event padding_event : padding_events)
+        {
+            status = clReleaseEvent(padding_event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+    }
+
+    return next_multiple;
+}
+
+bool HashTable::Insert(cl_mem keys_buffer, cl_mem values_buffer, size_t num_padded_keys, cl_uint num_wait_events, const cl_event* wait_events)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // The entries left over are only written for the recovery pass, otherwise the kernel gets no buffer for them
+    cl_mem failed_entries_buffer = 0;
+    if (retry_failed_keys)
+    {
+        ReserveEntries(num_padded_keys);
+        failed_entries_buffer = failed_entries_buffer_;
     }
 
-    // 3. Construct status buffer
-    cl_mem status_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, sizeof(uint32_t), NULL, NULL);
-    int intital_status = 0;
-    status = clEnqueueWriteBuffer(mgr->command_queue, status_buffer, CL_TRUE, 0, sizeof(uint32_t), &intital_status, 0, NULL, NULL);
+    // 1. Reset status buffer
+    const uint32_t initial_status = mpp::ReturnCode::CODE_SUCCESS;
+    std::vector<cl_event> insert_wait_events(wait_events, wait_events + num_wait_events);
+    insert_wait_events.push_back(0);
+    status = clEnqueueFillBuffer(mgr->command_queue, status_buffer_, &initial_status, sizeof(uint32_t), 0, sizeof(uint32_t), 0, NULL, &insert_wait_events.back());
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // 4. Run kernel    
+    // 2. Run kernel after the table, the parameters and the status are reset
     const cl_kernel kernel_hashtable_insert = mgr->kernel_map[mpp::kernels::HASHTABLE_INSERT];
-    // args: __global uint32_t* keys, __global uint32_t* values, __global uint64_t* table, __constant uint32_t* params, __global uint32_t* out_status
+    // args: __global const uint32_t* keys, __global const uint32_t* values, __global uint64_t* table, __constant uint32_t* params, __global uint32_t* status,
+    //       __global uint64_t* out_failed_entries
     status = clSetKernelArg(kernel_hashtable_insert, 0, sizeof(cl_mem), (void*)&keys_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clSetKernelArg(kernel_hashtable_insert, 1, sizeof(cl_mem), (void*)&values_buffer);
@@ -122,46 +283,279 @@ bool HashTable::Insert(const std::vector<uint32_t>& keys, const std::vector<uint
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clSetKernelArg(kernel_hashtable_insert, 3, sizeof(cl_mem), (void*)&params_buffer_);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clSetKernelArg(kernel_hashtable_insert, 4, sizeof(cl_mem), (void*)&status_buffer);
+    status = clSetKernelArg(kernel_hashtable_insert, 4, sizeof(cl_mem), (void*)&status_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_hashtable_insert, 5, sizeof(cl_mem), (void*)&failed_entries_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    size_t global_work_size[1] = { static_cast<size_t>(next_multiple) };
-    size_t local_work_size[1] = { std::min(static_cast<size_t>(THREAD_BLOCK_SIZE), static_cast<size_t>(next_multiple)) };
-    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_hashtable_insert, 1, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    cl_event insert_event = 0;
+    size_t global_work_size[1] = { num_padded_keys };
+    size_t local_work_size[1] = { std::min(static_cast<size_t>(THREAD_BLOCK_SIZE), num_padded_keys) };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_hashtable_insert, 1, NULL, global_work_size, local_work_size,
+        static_cast<cl_uint>(insert_wait_events.size()), insert_wait_events.data(), &insert_event);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // 5. Error checking - Check if max iterations have been exceeded
-    // In theory we could check which elements failed to be inserted, then take the original state of the hashtable, generate new hash parameters and then reconstruct the hashtable
-    // from scratch. There probably are elements left which could not be inserted due to collision though...
-    // For now it's assumed that insert is only called once.
+    // 3. Error checking - Check if max iterations have been exceeded. Only this status word is read back.
+    uint32_t kernel_status = mpp::ReturnCode::CODE_SUCCESS;
+    status = clEnqueueReadBuffer(mgr->command_queue, status_buffer_, CL_TRUE, 0, sizeof(uint32_t), &kernel_status, 1, &insert_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 4. Cleanup -> Release events
+    status = clReleaseEvent(insert_wait_events.back());
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(insert_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 5. Recover from a failed insertion by re-inserting only the entries left over
+    if (kernel_status != mpp::ReturnCode::CODE_SUCCESS && retry_failed_keys)
+    {
+        return Reinsert(num_padded_keys);
+    }
+
+    return kernel_status == mpp::ReturnCode::CODE_SUCCESS;
+}
+
+bool HashTable::Reinsert(size_t num_padded_keys)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
 
+    // 1. Compact the failed entries with the scan based stream compaction, only their number is read back
+    num_retried_entries_ = compaction_.Compact(failed_entries_buffer_, num_padded_keys, "(uint)(x >> 32) != 0xFFFFFFFFu", retry_entries_buffer_);
+    if (num_retried_entries_ == 0)
+    {
+        return true;
+    }
+
+    // 2. Reset status buffer
+    const uint32_t initial_status = mpp::ReturnCode::CODE_SUCCESS;
+    cl_event fill_event = 0;
+    status = clEnqueueFillBuffer(mgr->command_queue, status_buffer_, &initial_status, sizeof(uint32_t), 0, sizeof(uint32_t), 0, NULL, &fill_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 3. Re-insert the compacted entries into the current table with a larger eviction budget
+    cl_uint num_entries_arg = static_cast<cl_uint>(num_retried_entries_);
+    const cl_kernel kernel_hashtable_reinsert = mgr->kernel_map[mpp::kernels::HASHTABLE_REINSERT];
+    // args: __global const uint64_t* entries, __global uint64_t* table, __constant uint32_t* params, __global uint32_t* status,
+    //       __private uint32_t num_entries, __private uint32_t max_iterations
+    status = clSetKernelArg(kernel_hashtable_reinsert, 0, sizeof(cl_mem), (void*)&retry_entries_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_hashtable_reinsert, 1, sizeof(cl_mem), (void*)&table_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_hashtable_reinsert, 2, sizeof(cl_mem), (void*)&params_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_hashtable_reinsert, 3, sizeof(cl_mem), (void*)&status_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_hashtable_reinsert, 4, sizeof(cl_uint), &num_entries_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_hashtable_reinsert, 5, sizeof(cl_uint), &max_retry_iterations);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event reinsert_event = 0;
+    size_t global_work_size[1] = { Utility::GetNextMultipleOf(num_entries_arg, THREAD_BLOCK_SIZE) };
+    size_t local_work_size[1] = { THREAD_BLOCK_SIZE };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_hashtable_reinsert, 1, NULL, global_work_size, local_work_size, 1, &fill_event, &reinsert_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 4. Read back the status, a failure falls back to a full rebuild
     uint32_t kernel_status = mpp::ReturnCode::CODE_SUCCESS;
-    status = clEnqueueReadBuffer(mgr->command_queue, status_buffer, CL_TRUE, 0, sizeof(uint32_t), &kernel_status, 0, NULL, NULL);
+    status = clEnqueueReadBuffer(mgr->command_queue, status_buffer_, CL_TRUE, 0, sizeof(uint32_t), &kernel_status, 1, &reinsert_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 5. Cleanup -> Release events
+    status = clReleaseEvent(fill_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(reinsert_event);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // DEBUG - Check which/how many elements failed to be inserted
-    //if(kernel_status != mpp::ReturnCode::CODE_SUCCESS)
-    //{
-    //    std::vector<uint32_t> status_per_element(next_multiple);
-    //    status = clEnqueueReadBuffer(mgr->command_queue, keys_buffer, CL_TRUE, 0, next_multiple * sizeof(uint32_t), status_per_element.data(), 0, NULL, NULL);
-    //    assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    //    // Assume that 0 and 1 are never used as keys for debug purposes
-    //    uint32_t num_unresolved_collisions = static_cast<uint32_t>(std::count(status_per_element.begin(), status_per_element.end(), mpp::ReturnCode::CODE_ERROR));
-    //    std::cout << "Host Table construction iteration: " << current_iteration_ << " Num unresolved collisions: " << num_unresolved_collisions << std::endl;
-    //}
+    return kernel_status == mpp::ReturnCode::CODE_SUCCESS;
+}
 
-    // 6. Cleanup -> Release buffers
-    status = clReleaseMemObject(keys_buffer);
+bool HashTable::BuildPartitioned(cl_mem keys_buffer, cl_mem values_buffer, size_t num_keys, cl_uint num_wait_events, const cl_event* wait_events)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    uint32_t num_partitions = size_ / PARTITION_SLOTS;
+    cl_uint num_keys_arg = static_cast<cl_uint>(num_keys);
+    size_t global_work_size[1] = { Utility::GetNextMultipleOf(num_keys_arg, static_cast<uint32_t>(mpp::constants::MAX_THREADS_PER_CU)) };
+    size_t local_work_size[1] = { mpp::constants::MAX_THREADS_PER_CU };
+
+    // 1. The buffers of the partitioning are kept for later reconstructions
+    ReservePartitions(num_keys, num_partitions);
+
+    // 2. Partition of every key after the table and the parameters are reset
+    const cl_kernel kernel_partition = mgr->kernel_map[mpp::kernels::HASHTABLE_PARTITION];
+    // args: __global const uint32_t* keys, __global uint32_t* out_partitions, __constant uint32_t* params, __private uint32_t num_keys
+    status = clSetKernelArg(kernel_partition, 0, sizeof(cl_mem), (void*)&keys_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clReleaseMemObject(values_buffer);
+    status = clSetKernelArg(kernel_partition, 1, sizeof(cl_mem), (void*)&partitions_buffer_);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clReleaseMemObject(status_buffer);
+    status = clSetKernelArg(kernel_partition, 2, sizeof(cl_mem), (void*)&params_buffer_);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    
+    status = clSetKernelArg(kernel_partition, 3, sizeof(cl_uint), &num_keys_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event partition_event = 0;
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_partition, 1, NULL, global_work_size, local_work_size, num_wait_events, wait_events, &partition_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 3. Keys per partition and the exclusive scan of them, the first position of every partition
+    cl_event histogram_event = histogram_.Calculate(partitions_buffer_, num_keys, num_partitions, partition_counts_buffer_, partition_event);
+    partition_scan_.Reserve(num_partitions);
+    cl_event scan_event = partition_scan_.CalculateGPU(partition_counts_buffer_, partition_offsets_buffer_, num_partitions, histogram_event);
+
+    // 4. Group the entries by partition
+    const cl_uint zero = 0;
+    cl_event scatter_wait_events[2] = { scan_event, 0 };
+    status = clEnqueueFillBuffer(mgr->command_queue, partition_cursors_buffer_, &zero, sizeof(cl_uint), 0, num_partitions * sizeof(cl_uint), 0, NULL, &scatter_wait_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    const cl_kernel kernel_scatter = mgr->kernel_map[mpp::kernels::HASHTABLE_PARTITION_SCATTER];
+    // args: __global const uint32_t* keys, __global const uint32_t* values, __global const uint32_t* partitions, __global const uint32_t* partition_offsets,
+    //       __global uint32_t* partition_cursors, __global uint64_t* out_entries, __private uint32_t num_keys
+    status = clSetKernelArg(kernel_scatter, 0, sizeof(cl_mem), (void*)&keys_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 1, sizeof(cl_mem), (void*)&values_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 2, sizeof(cl_mem), (void*)&partitions_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 3, sizeof(cl_mem), (void*)&partition_offsets_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 4, sizeof(cl_mem), (void*)&partition_cursors_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 5, sizeof(cl_mem), (void*)&partition_entries_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 6, sizeof(cl_uint), &num_keys_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event build_wait_events[2] = { 0, 0 };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_scatter, 1, NULL, global_work_size, local_work_size, 2, scatter_wait_events, &build_wait_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 5. One work group per partition builds its sub-tables in local memory
+    const uint32_t initial_status = mpp::ReturnCode::CODE_SUCCESS;
+    status = clEnqueueFillBuffer(mgr->command_queue, status_buffer_, &initial_status, sizeof(uint32_t), 0, sizeof(uint32_t), 0, NULL, &build_wait_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    const cl_kernel kernel_build = mgr->kernel_map[mpp::kernels::HASHTABLE_BUILD_PARTITIONS];
+    // args: __global const uint64_t* entries, __global const uint32_t* partition_counts, __global const uint32_t* partition_offsets,
+    //       __global uint64_t* table, __constant uint32_t* params, __global uint32_t* status, __private uint32_t max_iterations
+    status = clSetKernelArg(kernel_build, 0, sizeof(cl_mem), (void*)&partition_entries_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_build, 1, sizeof(cl_mem), (void*)&partition_counts_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_build, 2, sizeof(cl_mem), (void*)&partition_offsets_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_build, 3, sizeof(cl_mem), (void*)&table_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_build, 4, sizeof(cl_mem), (void*)&params_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_build, 5, sizeof(cl_mem), (void*)&status_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_build, 6, sizeof(cl_uint), &max_partition_iterations);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event build_event = 0;
+    size_t build_global_work_size[1] = { num_partitions * mpp::constants::MAX_THREADS_PER_CU };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_build, 1, NULL, build_global_work_size, local_work_size, 2, build_wait_events, &build_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 6. A partition with too many keys or a too long eviction chain fails the build. Only this status word is read back.
+    uint32_t kernel_status = mpp::ReturnCode::CODE_SUCCESS;
+    status = clEnqueueReadBuffer(mgr->command_queue, status_buffer_, CL_TRUE, 0, sizeof(uint32_t), &kernel_status, 1, &build_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 7. Cleanup -> Release events
+    for (cl_event event : { partition_event, histogram_event, scan_event, scatter_wait_events[1], build_wait_events[0], build_wait_events[1], build_event })
+    {
+        status = clReleaseEvent(event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
     return kernel_status == mpp::ReturnCode::CODE_SUCCESS;
 }
 
+void HashTable::ReserveEntries(size_t num_padded_keys)
+{
+    if (num_padded_keys <= entries_capacity_)
+    {
+        return;
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    for (cl_mem* buffer : { &failed_entries_buffer_, &retry_entries_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        *buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_padded_keys * sizeof(uint64_t), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    entries_capacity_ = num_padded_keys;
+}
+
+void HashTable::ReservePartitions(size_t num_keys, uint32_t num_partitions)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // 1. Partition and entry of every key
+    if (num_keys > partition_keys_capacity_)
+    {
+        for (cl_mem* buffer : { &partitions_buffer_, &partition_entries_buffer_ })
+        {
+            if (*buffer != 0)
+            {
+                status = clReleaseMemObject(*buffer);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            }
+        }
+
+        partitions_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_keys * sizeof(cl_uint), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        partition_entries_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_keys * sizeof(uint64_t), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        partition_keys_capacity_ = num_keys;
+    }
+
+    // 2. Keys per partition, partition offsets and fill cursors
+    if (num_partitions > partitions_capacity_)
+    {
+        for (cl_mem* buffer : { &partition_counts_buffer_, &partition_offsets_buffer_, &partition_cursors_buffer_ })
+        {
+            if (*buffer != 0)
+            {
+                status = clReleaseMemObject(*buffer);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            }
+
+            *buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_partitions * sizeof(cl_uint), NULL, &status);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        partitions_capacity_ = num_partitions;
+    }
+}
+
 std::vector<uint32_t> HashTable::Retrieve(const std::vector<uint32_t>& keys)
+{
+    std::vector<uint32_t> retrieved_entries(keys.size());
+    Retrieve(keys.data(), keys.size(), retrieved_entries.data());
+    return retrieved_entries;
+}
+
+void HashTable::Retrieve(const uint32_t* keys, size_t num_keys, uint32_t* values)
 {
     OpenCLManager* mgr = OpenCLManager::GetInstance();
     assert(mgr != nullptr);
@@ -169,31 +563,26 @@ std::vector<uint32_t> HashTable::Retrieve(const std::vector<uint32_t>& keys)
 
     // 1. Allocate GPU memory
     cl_int next_multiple = static_cast<cl_int>(
-        Utility::GetNextMultipleOf(static_cast<uint32_t>(keys.size()), static_cast<uint32_t>(mpp::constants::WAVEFRONT_SIZE)));
+        Utility::GetNextMultipleOf(static_cast<uint32_t>(num_keys), static_cast<uint32_t>(mpp::constants::WAVEFRONT_SIZE)));
     cl_mem keys_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, next_multiple * sizeof(uint32_t), NULL, NULL);
     cl_mem vals_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(uint32_t), NULL, NULL);
 
     // 2. Fill buffer
-    status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer, CL_TRUE, 0, keys.size() * sizeof(uint32_t), keys.data(), 0, NULL, NULL);
+    status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer, CL_TRUE, 0, num_keys * sizeof(uint32_t), keys, 0, NULL, NULL);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
     // If necessary write padding
-    if (keys.size() < next_multiple)
+    if (num_keys < next_multiple)
     {
-        uint32_t num_padded_elements = next_multiple - static_cast<uint32_t>(keys.size());
+        uint32_t num_padded_elements = next_multiple - static_cast<uint32_t>(num_keys);
         std::vector<uint32_t> empty_elements(num_padded_elements, mpp::constants::EMPTY_32);
-        size_t offset = keys.size() * sizeof(uint32_t);
+        size_t offset = num_keys * sizeof(uint32_t);
         size_t num_bytes_written = num_padded_elements * sizeof(uint32_t);
         status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer, CL_TRUE, offset, num_bytes_written, empty_elements.data(), 0, NULL, NULL);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
     }
 
-    // 3. Construct parameters buffer
-    cl_mem params_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, params_.size() * sizeof(uint32_t), NULL, NULL);
-    status = clEnqueueWriteBuffer(mgr->command_queue, params_buffer, CL_TRUE, 0, params_.size() * sizeof(uint32_t), params_.data(), 0, NULL, NULL);
-    assert(status == mpp::ReturnCode::CODE_SUCCESS);
-
-    // 4. invoke retrieve kernel
+    // 3. invoke retrieve kernel, the parameters of the last reconstruction are still on the device
     const cl_kernel kernel_hashtable_retrieve = mgr->kernel_map[mpp::kernels::HASHTABLE_RETRIEVE];
     // params: __global int32_t* keys, __global int64_t* table, __constant uint32_t* params
     status = clSetKernelArg(kernel_hashtable_retrieve, 0, sizeof(cl_mem), (void*)&keys_buffer);
@@ -202,30 +591,27 @@ std::vector<uint32_t> HashTable::Retrieve(const std::vector<uint32_t>& keys)
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clSetKernelArg(kernel_hashtable_retrieve, 2, sizeof(cl_mem), (void*)&table_buffer_);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clSetKernelArg(kernel_hashtable_retrieve, 3, sizeof(cl_mem), (void*)&params_buffer);
+    status = clSetKernelArg(kernel_hashtable_retrieve, 3, sizeof(cl_mem), (void*)&params_buffer_);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
     size_t global_work_size[1] = { static_cast<size_t>(next_multiple) };
     size_t local_work_size[1] = { std::min(static_cast<size_t>(THREAD_BLOCK_SIZE), static_cast<size_t>(next_multiple)) };
 
-    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_hashtable_retrieve, 1, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    cl_event retrieve_event = 0;
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_hashtable_retrieve, 1, NULL, global_work_size, local_work_size, 0, NULL, &retrieve_event);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // 5. Read back results
-    std::vector<uint32_t> retrieved_entries(next_multiple);
-    status = clEnqueueReadBuffer(mgr->command_queue, vals_buffer, CL_TRUE, 0, next_multiple * sizeof(uint32_t), retrieved_entries.data(), 0, NULL, NULL);
+    // 4. Read back results after the kernel, the padding is skipped
+    status = clEnqueueReadBuffer(mgr->command_queue, vals_buffer, CL_TRUE, 0, num_keys * sizeof(uint32_t), values, 1, &retrieve_event, NULL);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // 6. Release buffers
+    // 5. Release buffers and events
+    status = clReleaseEvent(retrieve_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clReleaseMemObject(keys_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clReleaseMemObject(vals_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clReleaseMemObject(params_buffer);
-    assert(status == mpp::ReturnCode::CODE_SUCCESS);
-
-    retrieved_entries.resize(keys.size());
-    return retrieved_entries;
 }
 
 void HashTable::GenerateParams()
@@ -240,18 +626,21 @@ void HashTable::GenerateParams()
     params_[PARAM_IDX_HASHFUNC_B_3] = rand();
     params_[PARAM_IDX_MAX_ITERATIONS] = max_iterations;
     params_[PARAM_IDX_TABLESIZE] = size_;
+    params_[PARAM_IDX_HASHFUNC_A_STASH] = rand();
+    params_[PARAM_IDX_HASHFUNC_B_STASH] = rand();
+    params_[PARAM_IDX_STASH_SIZE] = (use_stash && layout != Layout::Partitioned) ? STASH_SIZE : 0;
+    params_[PARAM_IDX_BUCKET_SIZE] = (layout == Layout::Buckets) ? bucket_size : 0;
+    params_[PARAM_IDX_PARTITIONED] = (layout == Layout::Partitioned) ? 1 : 0;
+}
 
+uint32_t HashTable::GetNumStashedEntries()
+{
     OpenCLManager* mgr = OpenCLManager::GetInstance();
     assert(mgr != nullptr);
-    cl_int status = 0;
 
-    if (params_buffer_ != 0)
-    {
-        status = clReleaseMemObject(params_buffer_);
-        assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    }
-
-    params_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, params_.size() * sizeof(uint32_t), NULL, NULL);
-    status = clEnqueueWriteBuffer(mgr->command_queue, params_buffer_, CL_TRUE, 0, params_.size() * sizeof(uint32_t), params_.data(), 0, NULL, NULL);
+    std::vector<uint64_t> stash(STASH_SIZE);
+    cl_int status = clEnqueueReadBuffer(mgr->command_queue, table_buffer_, CL_TRUE, size_ * sizeof(uint64_t), STASH_SIZE * sizeof(uint64_t), stash.data(), 0, NULL, NULL);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return static_cast<uint32_t>(std::count_if(stash.begin(), stash.end(), [](uint64_t entry) { return entry != mpp::constants::EMPTY; }));
 }
@@ -2,18 +2,21 @@
 #include "catch.hpp"
 
 #include "Base/Definitions.h"
+#include "Base/MappedArray.h"
 #include "Base/OpenCLManager.h"
 #include "Base/Utilities.h"
 #include "HashTable/HashTable.h"
 
 #include <stdio.h>
+#include <fstream>
 #include <iostream>
 
 TEST_CASE("HashTable", "[gpu]")
 {
     Timer timer;
     OpenCLManager* mgr = OpenCLManager::GetInstance();
-    mgr->LoadKernel(mpp::filenames::KERNELS_HASHTABLE, { mpp::kernels::HASHTABLE_INSERT, mpp::kernels::HASHTABLE_RETRIEVE});
+    mgr->LoadKernel(mpp::filenames::KERNELS_HASHTABLE, { mpp::kernels::HASHTABLE_INSERT, mpp::kernels::HASHTABLE_REINSERT, mpp::kernels::HASHTABLE_RETRIEVE,
+        mpp::kernels::HASHTABLE_PARTITION, mpp::kernels::HASHTABLE_PARTITION_SCATTER, mpp::kernels::HASHTABLE_BUILD_PARTITIONS });
 
     SECTION("Try to retrieve element from empty table")
     {
@@ -244,6 +247,185 @@ TEST_CASE("HashTable", "[gpu]")
         REQUIRE(success == true);
     }
 
+    SECTION("Reconstruct on the device")
+    {
+        std::cout << "----- Hashmap Insert/Retrieve - 1000 elements, size_factor=2.0, max_iterations=0/3, max_reconstructions=3/20 ----- " << std::endl;
+        uint32_t num_elements = 1000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        // Without evictions no key can be placed, so every attempt fails and resets the table on the device
+        HashTable hash_table;
+        hash_table.table_size_factor = 2.0f;
+        hash_table.max_iterations = 0;
+        hash_table.max_reconstructions = 3;
+        bool success = hash_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        REQUIRE(success == false);
+        REQUIRE(hash_table.GetNumReconstructions() == 3);
+
+        // Short eviction chains usually need reconstructions, the keys and values stay on the device for all of them
+        timer.Reset();
+        hash_table.max_iterations = 3;
+        hash_table.max_reconstructions = 20;
+        success = hash_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        std::cout << "Duration GPU: " << timer.GetElapsed() << " seconds, reconstructions: " << hash_table.GetNumReconstructions() << std::endl;
+        REQUIRE(success == true);
+
+        std::vector<uint32_t> retrieved_vals = hash_table.Retrieve(keys);
+        REQUIRE(retrieved_vals == values);
+
+        // A smaller table reuses the buffers of the previous build
+        std::vector<uint32_t> small_keys(keys.begin(), keys.begin() + 100);
+        std::vector<uint32_t> small_values(values.begin(), values.begin() + 100);
+        success = hash_table.Init(static_cast<uint32_t>(small_keys.size()), small_keys, small_values);
+        REQUIRE(success == true);
+        REQUIRE(hash_table.Retrieve(small_keys) == small_values);
+    }
+
+    SECTION("Retry failed keys")
+    {
+        std::cout << "----- Hashmap Insert/Retrieve - 1000 elements, size_factor=2.0, max_iterations=1, retry failed keys ----- " << std::endl;
+        uint32_t num_elements = 1000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        // A single eviction step leaves every key whose first slot is taken over, those are re-inserted instead of rebuilding the table
+        timer.Reset();
+        HashTable hash_table;
+        hash_table.table_size_factor = 2.0f;
+        hash_table.max_iterations = 1;
+        hash_table.retry_failed_keys = true;
+        bool success = hash_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        std::cout << "Duration GPU: " << timer.GetElapsed() << " seconds, reconstructions: " << hash_table.GetNumReconstructions()
+            << ", retried entries: " << hash_table.GetNumRetriedEntries() << std::endl;
+        REQUIRE(success == true);
+        REQUIRE(hash_table.GetNumReconstructions() == 0);
+        REQUIRE(hash_table.GetNumRetriedEntries() > 0);
+        REQUIRE(hash_table.GetNumRetriedEntries() < num_elements / 2);
+
+        std::vector<uint32_t> retrieved_vals = hash_table.Retrieve(keys);
+        REQUIRE(retrieved_vals == values);
+    }
+
+    SECTION("Insert 1000 elements with stash")
+    {
+        std::cout << "----- Hashmap Insert/Retrieve - 1000 elements with stash ----- " << std::endl;
+        uint32_t num_elements = 1000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        // The default configuration of "Insert 1000 elements", the stash takes the few entries no eviction chain can place
+        timer.Reset();
+        HashTable hash_table;
+        hash_table.use_stash = true;
+        bool success = hash_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        std::cout << "Duration GPU: " << timer.GetElapsed() << " seconds, reconstructions: " << hash_table.GetNumReconstructions()
+            << ", stashed entries: " << hash_table.GetNumStashedEntries() << std::endl;
+        REQUIRE(success == true);
+        REQUIRE(hash_table.GetNumReconstructions() == 0);
+
+        std::vector<uint32_t> retrieved_vals = hash_table.Retrieve(keys);
+        REQUIRE(retrieved_vals == values);
+
+        // Without evictions every key goes to the stash
+        std::vector<uint32_t> stashed_keys(keys.begin(), keys.begin() + 50);
+        std::vector<uint32_t> stashed_values(values.begin(), values.begin() + 50);
+        HashTable stash_only_table;
+        stash_only_table.use_stash = true;
+        stash_only_table.max_iterations = 0;
+        success = stash_only_table.Init(static_cast<uint32_t>(stashed_keys.size()), stashed_keys, stashed_values);
+        REQUIRE(success == true);
+        REQUIRE(stash_only_table.GetNumStashedEntries() == stashed_keys.size());
+        REQUIRE(stash_only_table.Retrieve(stashed_keys) == stashed_values);
+
+        // Keys which are neither in the table nor in the stash
+        std::vector<uint32_t> missing_keys = { 0, 1, num_elements + 2, num_elements + 100 };
+        for (uint32_t val : hash_table.Retrieve(missing_keys))
+        {
+            REQUIRE(val == mpp::constants::EMPTY_32);
+        }
+    }
+
+    SECTION("Bucketized layout")
+    {
+        std::cout << "----- Hashmap Insert/Retrieve - 1000 elements, bucketized layout, size_factor=1.1 ----- " << std::endl;
+        uint32_t num_elements = 1000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        for (uint32_t bucket_size : { 4, 8 })
+        {
+            HashTable hash_table;
+            hash_table.layout = HashTable::Layout::Buckets;
+            hash_table.bucket_size = bucket_size;
+            hash_table.table_size_factor = 1.1f;
+            hash_table.max_iterations = 7 * static_cast<uint32_t>(log(num_elements));
+            bool success = hash_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+            REQUIRE(success == true);
+
+            std::vector<uint32_t> retrieved_vals = hash_table.Retrieve(keys);
+            REQUIRE(retrieved_vals == values);
+
+            std::vector<uint32_t> missing_keys = { 0, 1, num_elements + 2, num_elements + 100 };
+            for (uint32_t val : hash_table.Retrieve(missing_keys))
+            {
+                REQUIRE(val == mpp::constants::EMPTY_32);
+            }
+        }
+    }
+
+    SECTION("Two-level layout")
+    {
+        std::cout << "----- Hashmap Insert/Retrieve - 1000 elements, two-level layout ----- " << std::endl;
+        uint32_t num_elements = 1000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        HashTable hash_table;
+        hash_table.layout = HashTable::Layout::Partitioned;
+        bool success = hash_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        REQUIRE(success == true);
+
+        std::vector<uint32_t> retrieved_vals = hash_table.Retrieve(keys);
+        REQUIRE(retrieved_vals == values);
+
+        std::vector<uint32_t> missing_keys = { 0, 1, num_elements + 2, num_elements + 100 };
+        for (uint32_t val : hash_table.Retrieve(missing_keys))
+        {
+            REQUIRE(val == mpp::constants::EMPTY_32);
+        }
+    }
+
     SECTION("Insert a million elements")
     {
         std::cout << "----- Hashmap Insert - 1'000'000 elements (aborted insertion on GPU) ----- " << std::endl;
@@ -377,4 +559,144 @@ TEST_CASE("HashTable", "[gpu]")
         REQUIRE(retrieved_vals.size() == keys.size());
         REQUIRE(retrieved_vals == values);
     }
+
+    SECTION("Retrieve a million elements, bucketized layout vs. four hash functions")
+    {
+        std::cout << "----- Hashmap Retrieve - 1'000'000 elements, buckets of 8 (size_factor=1.1) vs. four hash functions (size_factor=1.25) ----- " << std::endl;
+        uint32_t num_elements = 1'000'000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        std::unordered_map<uint32_t, uint32_t> cpu_hash;
+        cpu_hash.reserve(num_elements);
+        for (uint32_t i = 0; i < keys.size(); ++i)
+        {
+            cpu_hash.insert({ keys[i], values[i] });
+        }
+
+        timer.Reset();
+        std::unordered_map<uint32_t, uint32_t>::iterator it;
+        for (uint32_t i = 0; i < keys.size(); ++i)
+        {
+            it = cpu_hash.find(keys[i]);
+            if (it != cpu_hash.end())
+            {
+                uint32_t found_element = it->second;
+            }
+        }
+        std::cout << "Duration CPU: " << timer.GetElapsed() << " seconds" << std::endl;
+
+        HashTable four_functions_table;
+        four_functions_table.max_iterations = 7 * static_cast<uint32_t>(log(num_elements));
+        bool success = four_functions_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        REQUIRE(success == true);
+
+        timer.Reset();
+        std::vector<uint32_t> retrieved_vals = four_functions_table.Retrieve(keys);
+        std::cout << "Duration GPU (four hash functions): " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(retrieved_vals == values);
+
+        HashTable buckets_table;
+        buckets_table.layout = HashTable::Layout::Buckets;
+        buckets_table.table_size_factor = 1.1f;
+        buckets_table.max_iterations = 7 * static_cast<uint32_t>(log(num_elements));
+        success = buckets_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        REQUIRE(success == true);
+
+        timer.Reset();
+        retrieved_vals = buckets_table.Retrieve(keys);
+        std::cout << "Duration GPU (buckets of 8): " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(retrieved_vals == values);
+    }
+
+    SECTION("Insert a million elements, two-level layout vs. four hash functions")
+    {
+        std::cout << "----- Hashmap Insert - 1'000'000 elements, two-level layout vs. four hash functions (max_iterations=7*log(N)) ----- " << std::endl;
+        uint32_t num_elements = 1'000'000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        timer.Reset();
+        std::unordered_map<uint32_t, uint32_t> cpu_hash;
+        cpu_hash.reserve(num_elements);
+        for (uint32_t i = 0; i < keys.size(); ++i)
+        {
+            cpu_hash.insert({ keys[i], values[i] });
+        }
+        std::cout << "Duration CPU: " << timer.GetElapsed() << " seconds" << std::endl;
+
+        timer.Reset();
+        HashTable four_functions_table;
+        four_functions_table.max_iterations = 7 * static_cast<uint32_t>(log(num_elements));
+        bool success = four_functions_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        std::cout << "Duration GPU (four hash functions): " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(success == true);
+
+        timer.Reset();
+        HashTable partitioned_table;
+        partitioned_table.layout = HashTable::Layout::Partitioned;
+        success = partitioned_table.Init(static_cast<uint32_t>(keys.size()), keys, values);
+        std::cout << "Duration GPU (two-level): " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(success == true);
+
+        std::vector<uint32_t> retrieved_vals = partitioned_table.Retrieve(keys);
+        REQUIRE(retrieved_vals == values);
+    }
+
+    SECTION("Insert and retrieve from mapped files")
+    {
+        std::cout << "----- Hashmap Insert/Retrieve - 1'000'000 elements from mapped files ----- " << std::endl;
+        uint32_t num_elements = 1'000'000;
+        std::vector<uint32_t> keys(num_elements);
+        std::vector<uint32_t> values(num_elements);
+        for (uint32_t i = 0; i < num_elements; ++i)
+        {
+            keys[i] = (i + 2);
+            values[i] = (i + 3);
+        }
+
+        // Key and value columns as binary files
+        std::ofstream keys_file("hashtable_keys.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+        keys_file.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint32_t));
+        keys_file.close();
+        std::ofstream values_file("hashtable_values.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+        values_file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(uint32_t));
+        values_file.close();
+
+        {
+            MappedArray<uint32_t> mapped_keys;
+            MappedArray<uint32_t> mapped_values;
+            REQUIRE(mapped_keys.Open("hashtable_keys.bin"));
+            REQUIRE(mapped_values.Open("hashtable_values.bin"));
+            REQUIRE(mapped_keys.size() == num_elements);
+
+            timer.Reset();
+            HashTable hash_table;
+            hash_table.max_iterations = 7 * static_cast<uint32_t>(log(num_elements));
+            bool success = hash_table.Init(num_elements, mapped_keys.data(), mapped_values.data(), mapped_keys.size());
+            std::cout << "Duration GPU (mapped build): " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(success == true);
+
+            MappedArray<uint32_t> mapped_result;
+            REQUIRE(mapped_result.Create("hashtable_result.bin", num_elements));
+            hash_table.Retrieve(mapped_keys.data(), mapped_keys.size(), mapped_result.data());
+            REQUIRE(std::equal(mapped_result.begin(), mapped_result.end(), values.begin()));
+        }
+
+        std::remove("hashtable_keys.bin");
+        std::remove("hashtable_values.bin");
+        std::remove("hashtable_result.bin");
+    }
 }
@@ -0,0 +1,186 @@
+#include "Base/Definitions.h"
+#include "Base/OpenCLManager.h"
+#include "PrefixSum/Histogram.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string>
+
+std::vector<cl_uint> Histogram::CalculateCPU(const std::vector<cl_uint>& keys, uint32_t num_bins, uint32_t shift)
+{
+    std::vector<cl_uint> histogram(num_bins, 0);
+    for (cl_uint key : keys)
+    {
+        ++histogram[(key >> shift) % num_bins];
+    }
+
+    return histogram;
+}
+
+Histogram::Histogram(size_t max_num_elements, uint32_t max_num_bins)
+{
+    Reserve(max_num_elements, max_num_bins);
+}
+
+Histogram::~Histogram()
+{
+    Release();
+}
+
+void Histogram::Reserve(size_t max_num_elements, uint32_t max_num_bins)
+{
+    if (max_num_elements <= capacity_ && max_num_bins <= bins_capacity_)
+    {
+        return;
+    }
+
+    max_num_elements = std::max(max_num_elements, capacity_);
+    max_num_bins = std::max(max_num_bins, bins_capacity_);
+    Release();
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    keys_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, std::max<size_t>(max_num_elements, 1) * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    histogram_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, max_num_bins * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    offsets_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, max_num_bins * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    scan_.Reserve(max_num_bins);
+    capacity_ = max_num_elements;
+    bins_capacity_ = max_num_bins;
+}
+
+std::vector<cl_uint> Histogram::Calculate(const std::vector<cl_uint>& keys, uint32_t num_bins)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    cl_event histogram_event = Upload(keys, num_bins);
+
+    std::vector<cl_uint> histogram(num_bins);
+    status = clEnqueueReadBuffer(mgr->command_queue, histogram_buffer_, CL_TRUE, 0, num_bins * sizeof(cl_uint), histogram.data(), 1, &histogram_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(histogram_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return histogram;
+}
+
+std::vector<cl_uint> Histogram::CalculateOffsets(const std::vector<cl_uint>& keys, uint32_t num_bins)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    cl_event histogram_event = Upload(keys, num_bins);
+
+    // The histogram stays on the device, only the offsets are read back
+    cl_event scan_event = scan_.CalculateGPU(histogram_buffer_, offsets_buffer_, num_bins, histogram_event);
+    status = clReleaseEvent(histogram_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    std::vector<cl_uint> offsets(num_bins);
+    status = clEnqueueReadBuffer(mgr->command_queue, offsets_buffer_, CL_TRUE, 0, num_bins * sizeof(cl_uint), offsets.data(), 1, &scan_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return offsets;
+}
+
+cl_event Histogram::Upload(const std::vector<cl_uint>& keys, uint32_t num_bins)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(keys.size(), num_bins);
+
+    cl_event write_event = 0;
+    if (!keys.empty())
+    {
+        status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer_, CL_FALSE, 0, keys.size() * sizeof(cl_uint), keys.data(), 0, NULL, &write_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    cl_event histogram_event = Calculate(keys_buffer_, keys.size(), num_bins, histogram_buffer_, write_event);
+    if (write_event != 0)
+    {
+        status = clReleaseEvent(write_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    return histogram_event;
+}
+
+cl_event Histogram::Calculate(cl_mem keys_buffer, size_t num_elements, uint32_t num_bins, cl_mem histogram_buffer, cl_event wait_event)
+{
+    assert(num_bins > 0);
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // 1. Zero the global histogram, the work groups add to it
+    cl_uint zero = 0;
+    cl_event fill_event = 0;
+    status = clEnqueueFillBuffer(mgr->command_queue, histogram_buffer, &zero, sizeof(cl_uint), 0, num_bins * sizeof(cl_uint),
+        wait_event != 0 ? 1 : 0, wait_event != 0 ? &wait_event : NULL, &fill_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    if (num_elements == 0)
+    {
+        return fill_event;
+    }
+
+    // 2. Count. Every work group strides over the input, dimension 1 selects the bin range.
+    // Few work groups per range keep the number of global atomics low, ranges multiply the reads of the input.
+    size_t num_groups = std::min(MAX_NUM_GROUPS, (num_elements + WORK_GROUP_SIZE * ELEMENTS_PER_ITEM - 1) / (WORK_GROUP_SIZE * ELEMENTS_PER_ITEM));
+    size_t num_ranges = (num_bins + LOCAL_BINS - 1) / LOCAL_BINS;
+    size_t global_work_size[2] = { num_groups * WORK_GROUP_SIZE, num_ranges };
+    size_t local_work_size[2] = { WORK_GROUP_SIZE, 1 };
+
+    const cl_kernel kernel_histogram = mgr->GetKernel(mpp::filenames::KERNELS_HISTOGRAM, mpp::kernels::HISTOGRAM, "-DLOCAL_BINS=" + std::to_string(LOCAL_BINS));
+    cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+    status = clSetKernelArg(kernel_histogram, 0, sizeof(cl_mem), (void*)&keys_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_histogram, 1, sizeof(cl_mem), (void*)&histogram_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_histogram, 2, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_histogram, 3, sizeof(cl_uint), &num_bins);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_histogram, 4, sizeof(cl_uint), &shift);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event histogram_event = 0;
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_histogram, 2, NULL, global_work_size, local_work_size, 1, &fill_event, &histogram_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(fill_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return histogram_event;
+}
+
+void Histogram::Release()
+{
+    cl_int status = 0;
+
+    for (cl_mem* buffer : { &keys_buffer_, &histogram_buffer_, &offsets_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            *buffer = 0;
+        }
+    }
+
+    capacity_ = 0;
+    bins_capacity_ = 0;
+}
@@ -5,158 +5,954 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
 
-std::vector<cl_int> PrefixSum::CalculateCPU(const std::vector<cl_int>& elements)
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define PREFIX_SUM_SSE2
+#endif
+
+template<typename T, typename Op>
+std::vector<T> PrefixScan<T, Op>::CalculateCPU(const std::vector<T>& elements, ScanMode mode, bool reverse, T carry_in)
+{
+    T sum = carry_in;
+
+    std::vector<T> prefix_sum(elements.size());
+
+    for(size_t i = 0; i < elements.size(); ++i)
+    {
+        size_t index = reverse ? elements.size() - 1 - i : i;
+        T element = elements[index];
+
+        if (mode == ScanMode::Inclusive)
+        {
+            sum = Op::Apply(sum, element);
+            prefix_sum[index] = sum;
+        }
+        else
+        {
+            prefix_sum[index] = sum;
+            sum = Op::Apply(sum, element);
+        }
+    }
+
+    return prefix_sum;
+}
+
+namespace
+{
+    // Scans count elements starting at carry and returns the carry of the next block
+    template<typename T, typename Op>
+    T ScanBlock(const T* elements, T* prefix_sum, size_t count, bool inclusive, T carry)
+    {
+        size_t i = 0;
+
+#ifdef PREFIX_SUM_SSE2
+        if constexpr (std::is_same_v<Op, scan_op::Sum> && std::is_integral_v<T> && sizeof(T) == 4)
+        {
+            // In register scan of 8 (AVX2) or 4 (SSE2) elements: log2 shifted adds, the last element is broadcast as carry of the next vector.
+            // Integer adds wrap around like the scalar Sum.
+#ifdef __AVX2__
+            __m256i carry_v = _mm256_set1_epi32(static_cast<int>(carry));
+            const __m256i last_index = _mm256_set1_epi32(7);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements + i));
+                __m256i scan = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+                scan = _mm256_add_epi32(scan, _mm256_slli_si256(scan, 8));
+
+                // Add the total of the lower 128 bit lane to the upper lane
+                __m256i lane_totals = _mm256_shuffle_epi32(scan, _MM_SHUFFLE(3, 3, 3, 3));
+                scan = _mm256_add_epi32(scan, _mm256_permute2x128_si256(lane_totals, lane_totals, 0x08));
+
+                __m256i result = inclusive ? scan : _mm256_sub_epi32(scan, x);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(prefix_sum + i), _mm256_add_epi32(result, carry_v));
+                carry_v = _mm256_add_epi32(carry_v, _mm256_permutevar8x32_epi32(scan, last_index));
+            }
+            carry = static_cast<T>(_mm256_cvtsi256_si32(carry_v));
+#else
+            __m128i carry_v = _mm_set1_epi32(static_cast<int>(carry));
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+                __m128i scan = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+                scan = _mm_add_epi32(scan, _mm_slli_si128(scan, 8));
+
+                __m128i result = inclusive ? scan : _mm_sub_epi32(scan, x);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(prefix_sum + i), _mm_add_epi32(result, carry_v));
+                carry_v = _mm_add_epi32(carry_v, _mm_shuffle_epi32(scan, _MM_SHUFFLE(3, 3, 3, 3)));
+            }
+            carry = static_cast<T>(_mm_cvtsi128_si32(carry_v));
+#endif
+        }
+#endif
+
+        // Remaining elements and all other types/operators
+        for (; i < count; ++i)
+        {
+            T element = elements[i];
+            if (inclusive)
+            {
+                carry = Op::Apply(carry, element);
+                prefix_sum[i] = carry;
+            }
+            else
+            {
+                prefix_sum[i] = carry;
+                carry = Op::Apply(carry, element);
+            }
+        }
+
+        return carry;
+    }
+}
+
+template<typename T, typename Op>
+std::vector<T> PrefixScan<T, Op>::CalculateCPUParallel(const std::vector<T>& elements, size_t num_threads, ScanMode mode, T carry_in)
 {
-    uint32_t sum = 0;
+    // Small inputs aren't worth the thread start up, every thread gets at least 64K elements
+    static constexpr size_t MIN_ELEMENTS_PER_THREAD = 1 << 16;
+
+    if (num_threads == 0)
+    {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    num_threads = std::max<size_t>(std::min(num_threads, elements.size() / MIN_ELEMENTS_PER_THREAD), 1);
+
+    std::vector<T> prefix_sum(elements.size());
+    bool inclusive = mode == ScanMode::Inclusive;
+
+    // Runs func(block) for every block, block 0 on the calling thread
+    auto run_blocks = [num_threads](auto func)
+    {
+        std::vector<std::thread> threads;
+        for (size_t block = 1; block < num_threads; ++block)
+        {
+            threads.emplace_back(func, block);
+        }
+        func(0);
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    };
+
+    size_t block_size = (elements.size() + num_threads - 1) / num_threads;
+    auto block_begin = [&](size_t block) { return std::min(block * block_size, elements.size()); };
+    auto block_end = [&](size_t block) { return std::min((block + 1) * block_size, elements.size()); };
+
+    // 1. Reduce every block but the last one
+    std::vector<T> block_prefixes(num_threads, Op::template Identity<T>());
+    if (num_threads > 1)
+    {
+        run_blocks([&](size_t block)
+        {
+            if (block + 1 == num_threads)
+            {
+                return;
+            }
 
-    std::vector<cl_int> prefix_sum;
-    prefix_sum.reserve(elements.size());
+            T sum = Op::template Identity<T>();
+            for (size_t i = block_begin(block); i < block_end(block); ++i)
+            {
+                sum = Op::Apply(sum, elements[i]);
+            }
+            block_prefixes[block] = sum;
+        });
+    }
 
-    for(cl_int element : elements)
+    // 2. Exclusive scan of the block sums
+    T sum = carry_in;
+    for (T& block_prefix : block_prefixes)
     {
-        prefix_sum.push_back(sum);
-        sum += element;
+        T block_sum = block_prefix;
+        block_prefix = sum;
+        sum = Op::Apply(sum, block_sum);
     }
 
+    // 3. Scan every block starting at its prefix
+    run_blocks([&](size_t block)
+    {
+        size_t begin = block_begin(block);
+        ScanBlock<T, Op>(elements.data() + begin, prefix_sum.data() + begin, block_end(block) - begin, inclusive, block_prefixes[block]);
+    });
+
     return prefix_sum;
 }
 
-std::vector<cl_int> PrefixSum::CalculateGPU(const std::vector<cl_int>& elements)
+template<typename T, typename Op>
+PrefixScan<T, Op>::PrefixScan(size_t max_num_elements)
 {
+    Reserve(max_num_elements);
+}
+
+template<typename T, typename Op>
+PrefixScan<T, Op>::~PrefixScan()
+{
+    if (last_scan_event_ != 0)
+    {
+        cl_int status = clReleaseEvent(last_scan_event_);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    Release();
+}
+
+template<typename T, typename Op>
+void PrefixScan<T, Op>::Reserve(size_t max_num_elements)
+{
+    // The level sizes depend on the tile size, so a changed configuration needs new buffers as well
+    size_t tile_size = GetTileSize();
+    if (max_num_elements <= capacity_ && tile_size == reserved_tile_size_ && zero_copy == reserved_zero_copy_)
+    {
+        return;
+    }
+
+    Release();
+
     OpenCLManager* mgr = OpenCLManager::GetInstance();
     assert(mgr != nullptr);
     cl_int status = 0;
 
-    cl_int next_multiple = static_cast<cl_int>(
-        Utility::GetNextMultipleOf(static_cast<uint32_t>(elements.size()), static_cast<uint32_t>(mpp::constants::MAX_THREADS_PER_CU)));
-    
-    // Allocate buffer A & B
-    cl_mem input_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, next_multiple * sizeof(cl_int), NULL, NULL);           // Buffer A
-    status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer, CL_TRUE, 0, elements.size() * sizeof(cl_int), elements.data(), 0, NULL, NULL);
+    // Allocate buffer A & B. Zero copy buffers live in host memory the device can access directly.
+    cl_mem_flags host_flags = zero_copy ? CL_MEM_ALLOC_HOST_PTR : 0;
+    size_t next_multiple = Utility::GetNextMultipleOf(static_cast<uint32_t>(max_num_elements), static_cast<uint32_t>(tile_size));
+    input_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY | host_flags, next_multiple * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    result_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE | host_flags, next_multiple * sizeof(T), NULL, &status);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    cl_mem result_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_int), NULL, NULL);         // Buffer B
 
-    // If necessary pad to multiple of MAX_THREADS_PER_CU
-    if (elements.size() < next_multiple)
+    // Allocate buffer C & D of each recursion level. Level k stores one sum per sub array of the elements scanned on level k.
+    size_t num_sub_arrays = 0;
+    do
     {
-        cl_int zeros[mpp::constants::MAX_THREADS_PER_CU] = { 0 };
-        size_t offset = elements.size() * sizeof(cl_int);
-        size_t num_bytes_written = (next_multiple - elements.size()) * sizeof(cl_int);
-        status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer, CL_TRUE, offset, num_bytes_written, &zeros, 0, NULL, NULL);
+        num_sub_arrays = next_multiple / tile_size;
+        next_multiple = Utility::GetNextMultipleOf(static_cast<uint32_t>(num_sub_arrays), static_cast<uint32_t>(tile_size));
+
+        Level level;
+        level.c_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(T), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        level.d_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(T), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        levels_.push_back(level);
+    } while (num_sub_arrays > 1);
+
+    // Allocate the look-back state of the single pass scan
+    size_t num_tiles = Utility::GetNextMultipleOf(static_cast<uint32_t>(max_num_elements), static_cast<uint32_t>(tile_size)) / tile_size;
+    tile_status_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_tiles * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    tile_aggregates_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_tiles * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    tile_prefixes_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_tiles * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    tile_counter_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    capacity_ = max_num_elements;
+    reserved_tile_size_ = tile_size;
+    reserved_zero_copy_ = zero_copy;
+}
+
+template<typename T, typename Op>
+std::vector<T> PrefixScan<T, Op>::Calculate(const std::vector<T>& elements)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(elements.size());
+
+    // Fill buffer A. The command queue is out of order, so every command depends explicitly on the event of its predecessor.
+    cl_event write_event = 0;
+    if (zero_copy)
+    {
+        T* mapped_a = static_cast<T*>(clEnqueueMapBuffer(mgr->command_queue, input_buffer_, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0,
+            elements.size() * sizeof(T), 0, NULL, NULL, &status));
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        std::copy(elements.begin(), elements.end(), mapped_a);
+        status = clEnqueueUnmapMemObject(mgr->command_queue, input_buffer_, mapped_a, 0, NULL, &write_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+    else
+    {
+        status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, elements.size() * sizeof(T), elements.data(), 0, NULL, &write_event);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
     }
 
     // Call recursive function with A and B as input
-    PrefixSum::CalculateGPU_Recursive(input_buffer, result_buffer, next_multiple);
+    cl_event scan_event = CalculateGPU(input_buffer_, result_buffer_, elements.size(), write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Read result. This is the only blocking call of the scan.
+    std::vector<T> result(elements.size(), 0);
+    if (zero_copy)
+    {
+        T* mapped_b = static_cast<T*>(clEnqueueMapBuffer(mgr->command_queue, result_buffer_, CL_TRUE, CL_MAP_READ, 0,
+            elements.size() * sizeof(T), 1, &scan_event, NULL, &status));
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        std::copy(mapped_b, mapped_b + elements.size(), result.begin());
+
+        // B is written again by the next scan, so the unmap has to be done before returning
+        cl_event unmap_event = 0;
+        status = clEnqueueUnmapMemObject(mgr->command_queue, result_buffer_, mapped_b, 0, NULL, &unmap_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clWaitForEvents(1, &unmap_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clReleaseEvent(unmap_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+    else
+    {
+        status = clEnqueueReadBuffer(mgr->command_queue, result_buffer_, CL_TRUE, 0, elements.size() * sizeof(T), result.data(), 1, &scan_event, NULL);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return result;
+}
+
+template<typename T, typename Op>
+void PrefixScan<T, Op>::Calculate(const AlignedVector<T>& elements, AlignedVector<T>& result)
+{
+    result.resize(elements.size());
+    Calculate(elements.data(), result.data(), elements.size());
+}
+
+template<typename T, typename Op>
+void PrefixScan<T, Op>::Calculate(const T* elements, T* result, size_t num_elements)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(num_elements);
 
-    // Read result
-    std::vector<cl_int> result(elements.size(), 0);
-    status = clEnqueueReadBuffer(mgr->command_queue, result_buffer, CL_TRUE, 0, elements.size() * sizeof(cl_int), result.data(), 0, NULL, NULL);
+    // Wrap the host memory, the device works on it directly if it shares the memory with the host. The kernels only read A.
+    cl_mem a_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, num_elements * sizeof(T), const_cast<T*>(elements), &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    cl_mem b_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, num_elements * sizeof(T), result, &status);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // Release buffers
-    status = clReleaseMemObject(input_buffer);
+    // No write needed, the scan starts right away
+    cl_event start_event = 0;
+    status = clEnqueueMarkerWithWaitList(mgr->command_queue, 0, NULL, &start_event);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    status = clReleaseMemObject(result_buffer);
+    cl_event scan_event = CalculateGPU(a_buffer, b_buffer, num_elements, start_event);
+    status = clReleaseEvent(start_event);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    return result;
+    // Mapping B makes the result visible in result. On zero copy devices this only synchronizes, otherwise the device copies B back.
+    T* mapped_b = static_cast<T*>(clEnqueueMapBuffer(mgr->command_queue, b_buffer, CL_TRUE, CL_MAP_READ, 0, num_elements * sizeof(T), 1, &scan_event, NULL, &status));
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    assert(mapped_b == result);
+
+    cl_event unmap_event = 0;
+    status = clEnqueueUnmapMemObject(mgr->command_queue, b_buffer, mapped_b, 0, NULL, &unmap_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clWaitForEvents(1, &unmap_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    for (cl_event event : { scan_event, unmap_event })
+    {
+        status = clReleaseEvent(event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    status = clReleaseMemObject(a_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseMemObject(b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
 }
 
-void PrefixSum::CalculateGPU_Recursive(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements)
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::Enqueue(const T* elements, T* result, size_t num_elements, cl_event wait_event)
 {
     OpenCLManager* mgr = OpenCLManager::GetInstance();
     assert(mgr != nullptr);
+    assert(num_elements <= capacity_);
     cl_int status = 0;
 
-    cl_int next_multiple = static_cast<cl_int>(
-        Utility::GetNextMultipleOf(static_cast<uint32_t>(num_elements), static_cast<uint32_t>(mpp::constants::MAX_THREADS_PER_CU)));
-    cl_int num_sub_arrays = next_multiple / mpp::constants::MAX_THREADS_PER_CU;
+    cl_event write_event = 0;
+    status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, num_elements * sizeof(T), elements,
+        wait_event != 0 ? 1 : 0, wait_event != 0 ? &wait_event : NULL, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event scan_event = CalculateGPU(input_buffer_, result_buffer_, num_elements, write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event read_event = 0;
+    status = clEnqueueReadBuffer(mgr->command_queue, result_buffer_, CL_FALSE, 0, num_elements * sizeof(T), result, 1, &scan_event, &read_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return read_event;
+}
+
+namespace
+{
+    // One scan in flight of CalculateGPUAsync. Owned by the completion callback of its download.
+    template<typename T>
+    struct AsyncScan
+    {
+        std::vector<T> elements;
+        std::vector<T> result;
+        std::promise<std::vector<T>> promise;
+        cl_mem a_buffer = 0;
+        cl_mem b_buffer = 0;
+    };
 
-    // Allocate buffer C & D
-    cl_mem c_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_int), NULL, NULL);
-    cl_mem d_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_int), NULL, NULL);
-   
-    // If necessary pad to multiple of MAX_THREADS_PER_CU
-    if (num_elements < next_multiple)
+    template<typename T>
+    void CL_CALLBACK OnAsyncScanComplete(cl_event event, cl_int event_status, void* user_data)
     {
-        cl_int zeros[mpp::constants::MAX_THREADS_PER_CU] = { 0 };
-        size_t offset = num_elements * sizeof(cl_int);
-        size_t num_bytes_written = (next_multiple - num_elements) * sizeof(cl_int);
-        status = clEnqueueWriteBuffer(mgr->command_queue, c_buffer, CL_TRUE, offset, num_bytes_written, &zeros, 0, NULL, NULL);
+        std::unique_ptr<AsyncScan<T>> scan(static_cast<AsyncScan<T>*>(user_data));
+
+        assert(event_status == CL_COMPLETE);
+
+        cl_int status = clReleaseMemObject(scan->a_buffer);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clReleaseMemObject(scan->b_buffer);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
-        status = clEnqueueWriteBuffer(mgr->command_queue, d_buffer, CL_TRUE, offset, num_bytes_written, &zeros, 0, NULL, NULL);
+        status = clReleaseEvent(event);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        scan->promise.set_value(std::move(scan->result));
+    }
+}
+
+template<typename T, typename Op>
+std::future<std::vector<T>> PrefixScan<T, Op>::CalculateGPUAsync(std::vector<T> elements)
+{
+    auto scan = std::make_unique<AsyncScan<T>>();
+    std::future<std::vector<T>> future = scan->promise.get_future();
+    if (elements.empty())
+    {
+        scan->promise.set_value({});
+        return future;
     }
 
-    // Prepare prefix scan kernel
-    const cl_kernel kernel_prefix_scan = mgr->kernel_map[mpp::kernels::PREFIX_SUM];
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // 1. Own buffer A & B, the host memory of the scan moves into the scan until it completes
+    size_t num_elements = elements.size();
+    scan->elements = std::move(elements);
+    scan->result.resize(num_elements);
+    scan->a_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, num_elements * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    scan->b_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_elements * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    std::lock_guard<std::mutex> lock(mgr->enqueue_mutex);
+
+    // 2. The upload doesn't depend on anything, so it overlaps the scans still running
+    cl_event write_event = 0;
+    status = clEnqueueWriteBuffer(mgr->command_queue, scan->a_buffer, CL_FALSE, 0, num_elements * sizeof(T), scan->elements.data(), 0, NULL, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    Reserve(num_elements);
+    cl_event scan_event = EnqueueScan(scan->a_buffer, scan->b_buffer, num_elements, write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 3. Download, the callback fulfills the promise and releases the buffers
+    cl_event read_event = 0;
+    status = clEnqueueReadBuffer(mgr->command_queue, scan->b_buffer, CL_FALSE, 0, num_elements * sizeof(T), scan->result.data(), 1, &scan_event, &read_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    status = clSetEventCallback(read_event, CL_COMPLETE, OnAsyncScanComplete<T>, scan.release());
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clFlush(mgr->command_queue);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return future;
+}
+
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::CalculateGPUAsync(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+
+    std::lock_guard<std::mutex> lock(mgr->enqueue_mutex);
+    Reserve(num_elements);
+    cl_event scan_event = EnqueueScan(a_buffer, b_buffer, num_elements, wait_event);
+    cl_int status = clFlush(mgr->command_queue);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return scan_event;
+}
+
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::EnqueueScan(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // Join the caller's dependency and the previous scan of this instance, which uses the same buffer C & D and tile buffers
+    cl_event start_event = wait_event;
+    if (wait_event == 0 || last_scan_event_ != 0)
+    {
+        cl_event wait_events[2] = { 0, 0 };
+        cl_uint num_wait_events = 0;
+        for (cl_event event : { wait_event, last_scan_event_ })
+        {
+            if (event != 0)
+            {
+                wait_events[num_wait_events++] = event;
+            }
+        }
+
+        status = clEnqueueMarkerWithWaitList(mgr->command_queue, num_wait_events, num_wait_events > 0 ? wait_events : NULL, &start_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    cl_event scan_event = algorithm == Algorithm::SinglePass
+        ? CalculateGPU_SinglePass(a_buffer, b_buffer, num_elements, start_event)
+        : CalculateGPU_Recursive(0, a_buffer, b_buffer, num_elements, start_event);
+
+    if (start_event != wait_event)
+    {
+        status = clReleaseEvent(start_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    // Keep the scan event for the next call, the caller gets its own reference
+    if (last_scan_event_ != 0)
+    {
+        status = clReleaseEvent(last_scan_event_);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+    last_scan_event_ = scan_event;
+    status = clRetainEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return scan_event;
+}
+
+template<typename T, typename Op>
+std::vector<T> PrefixScan<T, Op>::CalculateGPU(const std::vector<T>& elements, Algorithm algorithm)
+{
+    PrefixScan prefix_sum(elements.size());
+    prefix_sum.algorithm = algorithm;
+    return prefix_sum.Calculate(elements);
+}
+
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::CalculateGPU(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+
+    std::lock_guard<std::mutex> lock(mgr->enqueue_mutex);
+    return EnqueueScan(a_buffer, b_buffer, num_elements, wait_event);
+}
+
+template<typename T, typename Op>
+std::vector<T> PrefixScan<T, Op>::CalculateBatch(const std::vector<T>& elements, const std::vector<cl_uint>& array_offsets)
+{
+    if (array_offsets.empty() || elements.empty())
+    {
+        return {};
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(elements.size());
+
+    // The offsets table gets the total number of elements as the end of the last array
+    size_t num_arrays = array_offsets.size();
+    if (num_arrays + 1 > batch_offsets_capacity_)
+    {
+        if (batch_offsets_buffer_ != 0)
+        {
+            status = clReleaseMemObject(batch_offsets_buffer_);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        batch_offsets_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, (num_arrays + 1) * sizeof(cl_uint), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        batch_offsets_capacity_ = num_arrays + 1;
+    }
+
+    // Fill buffer A and the offsets
+    const cl_uint num_elements = static_cast<cl_uint>(elements.size());
+    cl_event write_events[3] = { 0, 0, 0 };
+    status = clEnqueueWriteBuffer(mgr->command_queue, batch_offsets_buffer_, CL_FALSE, 0, num_arrays * sizeof(cl_uint), array_offsets.data(), 0, NULL, &write_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueWriteBuffer(mgr->command_queue, batch_offsets_buffer_, CL_FALSE, num_arrays * sizeof(cl_uint), sizeof(cl_uint), &num_elements, 0, NULL, &write_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, elements.size() * sizeof(T), elements.data(), 0, NULL, &write_events[2]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event write_event = 0;
+    status = clEnqueueMarkerWithWaitList(mgr->command_queue, 3, write_events, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    for (cl_event event : write_events)
+    {
+        status = clReleaseEvent(event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    cl_event scan_event = CalculateBatchGPU(input_buffer_, result_buffer_, batch_offsets_buffer_, num_arrays, write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Read all results at once. This is the only blocking call of the batch.
+    std::vector<T> result(elements.size(), 0);
+    status = clEnqueueReadBuffer(mgr->command_queue, result_buffer_, CL_TRUE, 0, elements.size() * sizeof(T), result.data(), 1, &scan_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return result;
+}
+
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::CalculateBatchGPU(cl_mem a_buffer, cl_mem b_buffer, cl_mem offsets_buffer, size_t num_arrays, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    const cl_kernel kernel_batched = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_SUM_BATCHED, GetBuildOptions(true), GetSourcePrefix(true));
+    status = clSetKernelArg(kernel_batched, 0, sizeof(cl_mem), (void*)&a_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_batched, 1, sizeof(cl_mem), (void*)&b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_batched, 2, sizeof(cl_mem), (void*)&offsets_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_batched, 3, sizeof(T), &carry_in);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // One work group per array
+    cl_event scan_event = 0;
+    size_t global_work_size[1] = { num_arrays * work_group_size };
+    size_t local_work_size[1] = { work_group_size };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_batched, 1, NULL, global_work_size, local_work_size,
+        wait_event != 0 ? 1 : 0, wait_event != 0 ? &wait_event : NULL, &scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return scan_event;
+}
+
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::CalculateGPU_Recursive(size_t level, cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    assert(level < levels_.size());
+    cl_int status = 0;
+
+    size_t tile_size = GetTileSize();
+    size_t next_multiple = Utility::GetNextMultipleOf(static_cast<uint32_t>(num_elements), static_cast<uint32_t>(tile_size));
+    size_t num_sub_arrays = next_multiple / tile_size;
+    std::string build_options = GetBuildOptions(level == 0);
+    std::string source_prefix = GetSourcePrefix(level == 0);
+
+    // Buffer C & D are allocated up front by Reserve()
+    cl_mem c_buffer = levels_[level].c_buffer;
+    cl_mem d_buffer = levels_[level].d_buffer;
+
+    // The carry-in enters at the deepest level, from there it's part of every sub array sum of the levels above
+    cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+    T level_carry_in = num_sub_arrays == 1 ? carry_in : Op::template Identity<T>();
+
+    // Prepare prefix scan kernel. Elements behind num_elements are read as the identity, so A doesn't need padding.
+    const cl_kernel kernel_prefix_scan = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_SUM, build_options, source_prefix);
     status = clSetKernelArg(kernel_prefix_scan, 0, sizeof(cl_mem), (void*)&a_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clSetKernelArg(kernel_prefix_scan, 1, sizeof(cl_mem), (void*)&b_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
     status = clSetKernelArg(kernel_prefix_scan, 2, sizeof(cl_mem), (void*)&c_buffer);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_prefix_scan, 3, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_prefix_scan, 4, sizeof(T), &level_carry_in);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
     // Run prefix scan kernel
-    size_t global_work_size[1] = { static_cast<size_t>(next_multiple) };
-    size_t local_work_size[1] = { static_cast<size_t>(mpp::constants::MAX_THREADS_PER_CU) };
-    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_prefix_scan, 1, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    cl_event scan_event = 0;
+    size_t global_work_size[1] = { num_sub_arrays * work_group_size };
+    size_t local_work_size[1] = { work_group_size };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_prefix_scan, 1, NULL, global_work_size, local_work_size, 1, &wait_event, &scan_event);
     assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    // debug
-    //{
-    //    std::vector<cl_int> vec_c_buffer(num_sub_arrays, 0);
-    //    status = clEnqueueReadBuffer(mgr->command_queue, c_buffer, CL_TRUE, 0, num_sub_arrays * sizeof(cl_int), vec_c_buffer.data(), 0, NULL, NULL);
-    //    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    if(num_sub_arrays == 1)
+    {
+        return scan_event;
+    }
 
-    //    std::vector<cl_int> vec_d_buffer(num_sub_arrays, 0);
-    //    status = clEnqueueReadBuffer(mgr->command_queue, d_buffer, CL_TRUE, 0, num_sub_arrays * sizeof(cl_int), vec_d_buffer.data(), 0, NULL, NULL);
-    //    assert(status == mpp::ReturnCode::CODE_SUCCESS);
-    //}
+    cl_event sub_array_event = CalculateGPU_Recursive(level + 1, c_buffer, d_buffer, num_sub_arrays, scan_event);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-    if(num_sub_arrays > 1)
+    if (debug_validation)
     {
-        CalculateGPU_Recursive(c_buffer, d_buffer, num_sub_arrays);
+        ValidateSubArraySums(c_buffer, d_buffer, num_sub_arrays, sub_array_event);
+    }
 
-        // debug
-        {
-            std::vector<cl_int> vec_c_buffer(num_sub_arrays, 0);
-            status = clEnqueueReadBuffer(mgr->command_queue, c_buffer, CL_TRUE, 0, num_sub_arrays * sizeof(cl_int), vec_c_buffer.data(), 0, NULL, NULL);
-            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    // Set kernel arguments.
+    const cl_kernel kernel_calc_e = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_CALC_E, build_options, source_prefix);
+    status = clSetKernelArg(kernel_calc_e, 0, sizeof(cl_mem), (void*)&b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_calc_e, 1, sizeof(cl_mem), (void*)&d_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_calc_e, 2, sizeof(cl_mem), (void*)&b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_calc_e, 3, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-            std::vector<cl_int> vec_d_buffer(num_sub_arrays, 0);
-            status = clEnqueueReadBuffer(mgr->command_queue, d_buffer, CL_TRUE, 0, num_sub_arrays * sizeof(cl_int), vec_d_buffer.data(), 0, NULL, NULL);
-            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    // Run the kernel.
+    cl_event calc_e_event = 0;
+    size_t calc_e_global_work_size[1] = { num_sub_arrays * work_group_size };
+    size_t calc_e_local_work_size[1] = { work_group_size };    // One work group per tile, each work item adds to elements_per_work_item elements
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_calc_e, 1, NULL, calc_e_global_work_size, calc_e_local_work_size, 1, &sub_array_event, &calc_e_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(sub_array_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return calc_e_event;
+}
+
+template<typename T, typename Op>
+void PrefixScan<T, Op>::ValidateSubArraySums(cl_mem c_buffer, cl_mem d_buffer, size_t num_sub_arrays, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // Blocking readback of the sums of one level, D has to be the exclusive scan of C starting at the carry-in
+    std::vector<T> vec_c_buffer(num_sub_arrays, 0);
+    status = clEnqueueReadBuffer(mgr->command_queue, c_buffer, CL_TRUE, 0, num_sub_arrays * sizeof(T), vec_c_buffer.data(), 1, &wait_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    std::vector<T> vec_d_buffer(num_sub_arrays, 0);
+    status = clEnqueueReadBuffer(mgr->command_queue, d_buffer, CL_TRUE, 0, num_sub_arrays * sizeof(T), vec_d_buffer.data(), 1, &wait_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Floating point sums differ in the order of their additions from the host, so they are compared with a tolerance
+    std::vector<T> expected = CalculateCPU(vec_c_buffer, ScanMode::Exclusive, false, carry_in);
+    bool is_valid = std::equal(vec_d_buffer.begin(), vec_d_buffer.end(), expected.begin(), [](T result, T expected_result)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            return std::abs(result - expected_result) <= T(1e-3) * std::max({ T(1), std::abs(result), std::abs(expected_result) });
+        }
+        else
+        {
+            return result == expected_result;
         }
+    });
+
+    if (!is_valid)
+    {
+        std::cerr << "PrefixSum validation failed for " << num_sub_arrays << " sub arrays" << std::endl;
+        assert(false);
+    }
+}
+
+template<typename T, typename Op>
+cl_event PrefixScan<T, Op>::CalculateGPU_SinglePass(cl_mem a_buffer, cl_mem b_buffer, size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    size_t tile_size = GetTileSize();
+    size_t num_tiles = Utility::GetNextMultipleOf(static_cast<uint32_t>(num_elements), static_cast<uint32_t>(tile_size)) / tile_size;
+
+    // Reset tile status and the dynamic tile counter after wait_event, the look-back of the previous scan may still read them
+    const cl_uint zero = 0;
+    cl_event reset_events[2] = { 0, 0 };
+    status = clEnqueueFillBuffer(mgr->command_queue, tile_status_buffer_, &zero, sizeof(cl_uint), 0, num_tiles * sizeof(cl_uint), 1, &wait_event, &reset_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueFillBuffer(mgr->command_queue, tile_counter_buffer_, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 1, &wait_event, &reset_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
 
-        // Set kernel arguments.
-        const cl_kernel kernel_calc_e = mgr->kernel_map[mpp::kernels::PREFIX_CALC_E];
-        status = clSetKernelArg(kernel_calc_e, 0, sizeof(cl_mem), (void*)&b_buffer);
+    // Set kernel arguments
+    cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+    const cl_kernel kernel_single_pass = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_SUM_SINGLE_PASS, GetBuildOptions(true), GetSourcePrefix(true));
+    status = clSetKernelArg(kernel_single_pass, 0, sizeof(cl_mem), (void*)&a_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 1, sizeof(cl_mem), (void*)&b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 2, sizeof(cl_mem), (void*)&tile_status_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 3, sizeof(cl_mem), (void*)&tile_aggregates_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 4, sizeof(cl_mem), (void*)&tile_prefixes_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 5, sizeof(cl_mem), (void*)&tile_counter_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 6, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_single_pass, 7, sizeof(T), &carry_in);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Run the kernel, one work group per tile
+    cl_event scan_event = 0;
+    size_t global_work_size[1] = { num_tiles * work_group_size };
+    size_t local_work_size[1] = { work_group_size };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_single_pass, 1, NULL, global_work_size, local_work_size, 2, reset_events, &scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    for (cl_event event : reset_events)
+    {
+        status = clReleaseEvent(event);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
-        status = clSetKernelArg(kernel_calc_e, 1, sizeof(cl_mem), (void*)&d_buffer);
+    }
+
+    return scan_event;
+}
+
+template<typename T, typename Op>
+void PrefixScan<T, Op>::Release()
+{
+    cl_int status = 0;
+
+    // Release buffers
+    for (Level& level : levels_)
+    {
+        status = clReleaseMemObject(level.d_buffer);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
-        status = clSetKernelArg(kernel_calc_e, 2, sizeof(cl_mem), (void*)&b_buffer);
+        status = clReleaseMemObject(level.c_buffer);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
-        status = clSetKernelArg(kernel_calc_e, 3, sizeof(cl_uint), &num_elements);
+    }
+    levels_.clear();
+
+    if (input_buffer_ != 0)
+    {
+        status = clReleaseMemObject(input_buffer_);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        input_buffer_ = 0;
+    }
 
-        // Run the kernel.
-        size_t global_work_size[1] = { static_cast<size_t>(next_multiple) };
-        size_t local_work_size[1] = { mpp::constants::MAX_THREADS_PER_CU };    // Use a full wavefront/warp as local work size
-        status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_calc_e, 1, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    if (result_buffer_ != 0)
+    {
+        status = clReleaseMemObject(result_buffer_);
         assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        result_buffer_ = 0;
+    }
+
+    for (cl_mem* buffer : { &tile_status_buffer_, &tile_aggregates_buffer_, &tile_prefixes_buffer_, &tile_counter_buffer_, &batch_offsets_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            *buffer = 0;
+        }
+    }
+
+    capacity_ = 0;
+    reserved_tile_size_ = 0;
+    reserved_zero_copy_ = false;
+    batch_offsets_capacity_ = 0;
+}
 
-        // Debug
-        //std::vector<cl_int> result(num_elements, 0);
-        //status = clEnqueueReadBuffer(mgr->command_queue, b_buffer, CL_TRUE, 0, num_elements * sizeof(cl_int), result.data(), 0, NULL, NULL);
-        //assert(status == mpp::ReturnCode::CODE_SUCCESS);
+template<typename T, typename Op>
+size_t PrefixScan<T, Op>::GetTileSize() const
+{
+    // The work group tree needs a power of two number of work items
+    assert(work_group_size > 0 && (work_group_size & (work_group_size - 1)) == 0);
+    assert(elements_per_work_item > 0);
 
-        // release buffers
-        status = clReleaseMemObject(d_buffer);
-        assert(status == mpp::ReturnCode::CODE_SUCCESS);
-        status = clReleaseMemObject(c_buffer);
-        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    return work_group_size * elements_per_work_item;
+}
+
+template<typename T, typename Op>
+std::string PrefixScan<T, Op>::GetTypeBuildOptions()
+{
+    return std::string("-DT=") + ScanType<T>::NAME +
+        " -DT_LOWEST=" + ScanType<T>::LOWEST +
+        " -DT_HIGHEST=" + ScanType<T>::HIGHEST +
+        " -DOP=" + Op::NAME;
+}
+
+template<typename T, typename Op>
+std::string PrefixScan<T, Op>::GetBuildOptions(bool top_level) const
+{
+    size_t log2_work_group_size = 0;
+    while ((size_t(1) << log2_work_group_size) < work_group_size)
+    {
+        ++log2_work_group_size;
+    }
+
+    std::string build_options = GetTypeBuildOptions() +
+        " -DMAX_THREADS_PER_CU=" + std::to_string(work_group_size) +
+        " -DLOG2_MAX_THREADS_PER_CU=" + std::to_string(log2_work_group_size) +
+        " -DELEMENTS_PER_ITEM=" + std::to_string(elements_per_work_item);
+
+    if (conflict_free_offsets)
+    {
+        build_options += " -DCONFLICT_FREE_OFFSETS";
+    }
+
+    if (top_level && mode == ScanMode::Inclusive)
+    {
+        build_options += " -DSCAN_INCLUSIVE";
     }
+
+    if (top_level && reverse)
+    {
+        build_options += " -DSCAN_REVERSE";
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    if (use_subgroups && mgr->subgroups_supported)
+    {
+        build_options += " -DUSE_SUBGROUPS " + mgr->subgroup_build_options;
+    }
+
+    return build_options;
 }
+
+template<typename T, typename Op>
+std::string PrefixScan<T, Op>::GetSourcePrefix(bool top_level) const
+{
+    std::string source_prefix;
+    if (!top_level)
+    {
+        return source_prefix;
+    }
+
+    // Functions evaluate x once, the macros replace the defaults of kernel_prefix_sum.cl
+    if (!load_transform.empty())
+    {
+        source_prefix += "inline T LoadTransform(T x) { return (T)(" + load_transform + "); }\n#define LOAD_TRANSFORM(x) LoadTransform(x)\n";
+    }
+
+    if (!store_transform.empty())
+    {
+        source_prefix += "inline T StoreTransform(T x) { return (T)(" + store_transform + "); }\n#define STORE_TRANSFORM(x) StoreTransform(x)\n";
+    }
+
+    return source_prefix;
+}
+
+// Explicit instantiations of all supported element types and operators
+#define INSTANTIATE_PREFIX_SCAN(T)                  \
+    template class PrefixScan<T, scan_op::Sum>;     \
+    template class PrefixScan<T, scan_op::Max>;     \
+    template class PrefixScan<T, scan_op::Min>;
+
+INSTANTIATE_PREFIX_SCAN(cl_int)
+INSTANTIATE_PREFIX_SCAN(cl_uint)
+INSTANTIATE_PREFIX_SCAN(cl_long)
+INSTANTIATE_PREFIX_SCAN(cl_ulong)
+INSTANTIATE_PREFIX_SCAN(cl_float)
+INSTANTIATE_PREFIX_SCAN(cl_double)
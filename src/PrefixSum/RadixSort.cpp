@@ -0,0 +1,250 @@
+#include "Base/Definitions.h"
+#include "Base/OpenCLManager.h"
+#include "PrefixSum/RadixSort.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <numeric>
+#include <string>
+
+void RadixSort::SortCPU(std::vector<cl_uint>& keys, std::vector<cl_uint>& values)
+{
+    assert(keys.size() == values.size());
+
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+    std::vector<cl_uint> sorted_keys(keys.size());
+    std::vector<cl_uint> sorted_values(values.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        sorted_keys[i] = keys[order[i]];
+        sorted_values[i] = values[order[i]];
+    }
+
+    keys.swap(sorted_keys);
+    values.swap(sorted_values);
+}
+
+RadixSort::RadixSort(size_t max_num_elements)
+{
+    Reserve(max_num_elements);
+}
+
+RadixSort::~RadixSort()
+{
+    Release();
+}
+
+void RadixSort::Reserve(size_t max_num_elements)
+{
+    if (max_num_elements <= capacity_)
+    {
+        return;
+    }
+
+    Release();
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // Histograms for the widest digit, so radix_bits can change without another allocation
+    size_t num_groups = (max_num_elements + TILE_SIZE - 1) / TILE_SIZE;
+    size_t num_counters = (size_t(1) << MAX_RADIX_BITS) * num_groups;
+
+    for (cl_mem* buffer : { &keys_buffer_, &values_buffer_, &temp_keys_buffer_, &temp_values_buffer_ })
+    {
+        *buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, max_num_elements * sizeof(cl_uint), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+    histograms_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_counters * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    offsets_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_counters * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    scan_.Reserve(num_counters);
+    capacity_ = max_num_elements;
+}
+
+void RadixSort::Sort(std::vector<cl_uint>& keys)
+{
+    if (keys.size() < 2)
+    {
+        return;
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(keys.size());
+
+    cl_event write_event = 0;
+    status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer_, CL_FALSE, 0, keys.size() * sizeof(cl_uint), keys.data(), 0, NULL, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event sort_event = Sort(keys_buffer_, 0, keys.size(), write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    status = clEnqueueReadBuffer(mgr->command_queue, keys_buffer_, CL_TRUE, 0, keys.size() * sizeof(cl_uint), keys.data(), 1, &sort_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(sort_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+}
+
+void RadixSort::Sort(std::vector<cl_uint>& keys, std::vector<cl_uint>& values)
+{
+    assert(keys.size() == values.size());
+    if (keys.size() < 2)
+    {
+        return;
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(keys.size());
+
+    cl_event write_events[2] = { 0, 0 };
+    status = clEnqueueWriteBuffer(mgr->command_queue, keys_buffer_, CL_FALSE, 0, keys.size() * sizeof(cl_uint), keys.data(), 0, NULL, &write_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueWriteBuffer(mgr->command_queue, values_buffer_, CL_FALSE, 0, values.size() * sizeof(cl_uint), values.data(), 0, NULL, &write_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Join both uploads, the first pass waits for a single event
+    cl_event write_event = 0;
+    status = clEnqueueMarkerWithWaitList(mgr->command_queue, 2, write_events, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    for (cl_event event : write_events)
+    {
+        status = clReleaseEvent(event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    cl_event sort_event = Sort(keys_buffer_, values_buffer_, keys.size(), write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    status = clEnqueueReadBuffer(mgr->command_queue, keys_buffer_, CL_FALSE, 0, keys.size() * sizeof(cl_uint), keys.data(), 1, &sort_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueReadBuffer(mgr->command_queue, values_buffer_, CL_FALSE, 0, values.size() * sizeof(cl_uint), values.data(), 1, &sort_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clFinish(mgr->command_queue);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(sort_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+}
+
+cl_event RadixSort::Sort(cl_mem keys_buffer, cl_mem values_buffer, size_t num_elements, cl_event wait_event)
+{
+    assert(radix_bits == 4 || radix_bits == 8);
+    assert(num_elements > 0);
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(num_elements);
+
+    bool key_value = values_buffer != 0;
+    std::string build_options = "-DRADIX_BITS=" + std::to_string(radix_bits) + " -DWORK_GROUP_SIZE=" + std::to_string(WORK_GROUP_SIZE)
+        + " -DELEMENTS_PER_ITEM=" + std::to_string(ELEMENTS_PER_ITEM);
+    if (key_value)
+    {
+        build_options += " -DRADIX_KEY_VALUE";
+    }
+    const cl_kernel kernel_histogram = mgr->GetKernel(mpp::filenames::KERNELS_RADIX_SORT, mpp::kernels::RADIX_HISTOGRAM, build_options);
+    const cl_kernel kernel_scatter = mgr->GetKernel(mpp::filenames::KERNELS_RADIX_SORT, mpp::kernels::RADIX_SCATTER, build_options);
+
+    size_t num_groups = (num_elements + TILE_SIZE - 1) / TILE_SIZE;
+    size_t num_counters = (size_t(1) << radix_bits) * num_groups;
+    cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+    size_t global_work_size[1] = { num_groups * WORK_GROUP_SIZE };
+    size_t local_work_size[1] = { WORK_GROUP_SIZE };
+
+    // The key only kernels never touch the values, the key buffers stand in for them
+    cl_mem buffers[2][2] = { { keys_buffer, key_value ? values_buffer : keys_buffer }, { temp_keys_buffer_, key_value ? temp_values_buffer_ : temp_keys_buffer_ } };
+
+    // An even number of passes, so the result ends up in the input buffers
+    cl_event event = wait_event;
+    if (event != 0)
+    {
+        status = clRetainEvent(event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    for (cl_uint shift = 0, pass = 0; shift < 32; shift += radix_bits, ++pass)
+    {
+        cl_mem* in = buffers[pass % 2];
+        cl_mem* out = buffers[(pass + 1) % 2];
+
+        // 1. Digit histogram of every tile
+        status = clSetKernelArg(kernel_histogram, 0, sizeof(cl_mem), (void*)&in[0]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_histogram, 1, sizeof(cl_mem), (void*)&histograms_buffer_);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_histogram, 2, sizeof(cl_uint), &num_elements_arg);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_histogram, 3, sizeof(cl_uint), &shift);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        cl_event histogram_event = 0;
+        status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_histogram, 1, NULL, global_work_size, local_work_size,
+            event != 0 ? 1 : 0, event != 0 ? &event : NULL, &histogram_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        if (event != 0)
+        {
+            status = clReleaseEvent(event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        // 2. Exclusive scan of the digit major histograms
+        cl_event scan_event = scan_.CalculateGPU(histograms_buffer_, offsets_buffer_, num_counters, histogram_event);
+        status = clReleaseEvent(histogram_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        // 3. Stable scatter into the other buffers
+        status = clSetKernelArg(kernel_scatter, 0, sizeof(cl_mem), (void*)&in[0]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_scatter, 1, sizeof(cl_mem), (void*)&in[1]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_scatter, 2, sizeof(cl_mem), (void*)&out[0]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_scatter, 3, sizeof(cl_mem), (void*)&out[1]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_scatter, 4, sizeof(cl_mem), (void*)&offsets_buffer_);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_scatter, 5, sizeof(cl_uint), &num_elements_arg);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_scatter, 6, sizeof(cl_uint), &shift);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_scatter, 1, NULL, global_work_size, local_work_size, 1, &scan_event, &event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clReleaseEvent(scan_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    return event;
+}
+
+void RadixSort::Release()
+{
+    cl_int status = 0;
+
+    for (cl_mem* buffer : { &keys_buffer_, &values_buffer_, &temp_keys_buffer_, &temp_values_buffer_, &histograms_buffer_, &offsets_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            *buffer = 0;
+        }
+    }
+
+    capacity_ = 0;
+}
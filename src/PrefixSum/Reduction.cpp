@@ -0,0 +1,305 @@
+#include "Base/Definitions.h"
+#include "Base/OpenCLManager.h"
+#include "PrefixSum/Reduction.h"
+
+#include <assert.h>
+
+template<typename T, typename Op>
+T Reduction<T, Op>::CalculateCPU(const std::vector<T>& elements)
+{
+    T result = Op::template Identity<T>();
+    for (T element : elements)
+    {
+        result = Op::Apply(result, element);
+    }
+
+    return result;
+}
+
+template<typename T, typename Op>
+size_t Reduction<T, Op>::CalculateIndexCPU(const std::vector<T>& elements)
+{
+    assert(!elements.empty());
+
+    // Op::Apply(a, b) == b only if b is at least as good as a, strict improvements keep the first occurrence
+    size_t index = 0;
+    for (size_t i = 1; i < elements.size(); ++i)
+    {
+        if (elements[i] != elements[index] && Op::Apply(elements[index], elements[i]) == elements[i])
+        {
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+template<typename T, typename Op>
+Reduction<T, Op>::Reduction(size_t max_num_elements)
+{
+    Reserve(max_num_elements);
+}
+
+template<typename T, typename Op>
+Reduction<T, Op>::~Reduction()
+{
+    Release();
+}
+
+template<typename T, typename Op>
+void Reduction<T, Op>::Reserve(size_t max_num_elements)
+{
+    if (max_num_elements <= capacity_)
+    {
+        return;
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    if (input_buffer_ != 0)
+    {
+        status = clReleaseMemObject(input_buffer_);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    input_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, max_num_elements * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    capacity_ = max_num_elements;
+}
+
+template<typename T, typename Op>
+void Reduction<T, Op>::AllocatePartials()
+{
+    if (partials_buffer_ != 0)
+    {
+        return;
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    partials_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, MAX_NUM_GROUPS * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    partial_indices_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, MAX_NUM_GROUPS * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    result_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    index_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+}
+
+template<typename T, typename Op>
+T Reduction<T, Op>::Calculate(const std::vector<T>& elements)
+{
+    if (elements.empty())
+    {
+        return Op::template Identity<T>();
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    cl_event write_event = Upload(elements);
+    cl_event reduce_event = Calculate(input_buffer_, elements.size(), result_buffer_, write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // A single element is read back instead of the whole scan
+    T result = T();
+    status = clEnqueueReadBuffer(mgr->command_queue, result_buffer_, CL_TRUE, 0, sizeof(T), &result, 1, &reduce_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(reduce_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return result;
+}
+
+template<typename T, typename Op>
+size_t Reduction<T, Op>::CalculateIndex(const std::vector<T>& elements)
+{
+    assert(!elements.empty());
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    cl_event write_event = Upload(elements);
+    cl_event reduce_event = CalculateIndex(input_buffer_, elements.size(), result_buffer_, index_buffer_, write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_uint index = 0;
+    status = clEnqueueReadBuffer(mgr->command_queue, index_buffer_, CL_TRUE, 0, sizeof(cl_uint), &index, 1, &reduce_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(reduce_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return index;
+}
+
+template<typename T, typename Op>
+cl_event Reduction<T, Op>::Calculate(cl_mem input_buffer, size_t num_elements, cl_mem result_buffer, cl_event wait_event)
+{
+    assert(num_elements > 0);
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    AllocatePartials();
+
+    const cl_kernel kernel_reduce = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::REDUCE, PrefixScan<T, Op>::GetTypeBuildOptions());
+    size_t num_groups = GetNumGroups(num_elements);
+    size_t local_work_size[1] = { WORK_GROUP_SIZE };
+    cl_event event = wait_event;
+
+    // 1. Partial results of the work groups, a single work group writes the result directly
+    // 2. One work group reduces the partial results
+    for (size_t pass = 0; pass < 2 && num_elements > 0; ++pass)
+    {
+        cl_mem in = pass == 0 ? input_buffer : partials_buffer_;
+        cl_mem out = num_groups == 1 ? result_buffer : partials_buffer_;
+        cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+
+        status = clSetKernelArg(kernel_reduce, 0, sizeof(cl_mem), (void*)&in);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_reduce, 1, sizeof(cl_mem), (void*)&out);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_reduce, 2, sizeof(cl_uint), &num_elements_arg);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        cl_event reduce_event = 0;
+        size_t global_work_size[1] = { num_groups * WORK_GROUP_SIZE };
+        status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_reduce, 1, NULL, global_work_size, local_work_size,
+            event != 0 ? 1 : 0, event != 0 ? &event : NULL, &reduce_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        if (event != wait_event)
+        {
+            status = clReleaseEvent(event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+        event = reduce_event;
+
+        num_elements = num_groups == 1 ? 0 : num_groups;
+        num_groups = 1;
+    }
+
+    return event;
+}
+
+template<typename T, typename Op>
+cl_event Reduction<T, Op>::CalculateIndex(cl_mem input_buffer, size_t num_elements, cl_mem result_buffer, cl_mem index_buffer, cl_event wait_event)
+{
+    // The index of a sum is meaningless, ArgReduce exists for OP_MAX and OP_MIN only
+    assert(!(std::is_same_v<Op, scan_op::Sum>));
+    assert(num_elements > 0);
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    AllocatePartials();
+
+    const cl_kernel kernel_arg_reduce = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::ARG_REDUCE, PrefixScan<T, Op>::GetTypeBuildOptions());
+    size_t num_groups = GetNumGroups(num_elements);
+    size_t local_work_size[1] = { WORK_GROUP_SIZE };
+    cl_event event = wait_event;
+
+    // Same two passes as Calculate(), the second one reads the indices of the partial results
+    for (cl_uint pass = 0; pass < 2 && num_elements > 0; ++pass)
+    {
+        cl_mem in = pass == 0 ? input_buffer : partials_buffer_;
+        cl_mem out = num_groups == 1 ? result_buffer : partials_buffer_;
+        cl_mem out_indices = num_groups == 1 ? index_buffer : partial_indices_buffer_;
+        cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+
+        status = clSetKernelArg(kernel_arg_reduce, 0, sizeof(cl_mem), (void*)&in);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_arg_reduce, 1, sizeof(cl_mem), (void*)&partial_indices_buffer_);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_arg_reduce, 2, sizeof(cl_mem), (void*)&out);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_arg_reduce, 3, sizeof(cl_mem), (void*)&out_indices);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_arg_reduce, 4, sizeof(cl_uint), &num_elements_arg);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clSetKernelArg(kernel_arg_reduce, 5, sizeof(cl_uint), &pass);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        cl_event reduce_event = 0;
+        size_t global_work_size[1] = { num_groups * WORK_GROUP_SIZE };
+        status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_arg_reduce, 1, NULL, global_work_size, local_work_size,
+            event != 0 ? 1 : 0, event != 0 ? &event : NULL, &reduce_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        if (event != wait_event)
+        {
+            status = clReleaseEvent(event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+        event = reduce_event;
+
+        num_elements = num_groups == 1 ? 0 : num_groups;
+        num_groups = 1;
+    }
+
+    return event;
+}
+
+template<typename T, typename Op>
+cl_event Reduction<T, Op>::Upload(const std::vector<T>& elements)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+
+    Reserve(elements.size());
+    AllocatePartials();
+
+    cl_event write_event = 0;
+    cl_int status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, elements.size() * sizeof(T), elements.data(), 0, NULL, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return write_event;
+}
+
+template<typename T, typename Op>
+size_t Reduction<T, Op>::GetNumGroups(size_t num_elements) const
+{
+    size_t tile_size = WORK_GROUP_SIZE * ELEMENTS_PER_ITEM;
+    return std::min(MAX_NUM_GROUPS, (num_elements + tile_size - 1) / tile_size);
+}
+
+template<typename T, typename Op>
+void Reduction<T, Op>::Release()
+{
+    cl_int status = 0;
+
+    for (cl_mem* buffer : { &input_buffer_, &partials_buffer_, &partial_indices_buffer_, &result_buffer_, &index_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            *buffer = 0;
+        }
+    }
+
+    capacity_ = 0;
+}
+
+// Explicit instantiations of all supported element types and operators
+#define INSTANTIATE_REDUCTION(T)                \
+    template class Reduction<T, scan_op::Sum>;  \
+    template class Reduction<T, scan_op::Max>;  \
+    template class Reduction<T, scan_op::Min>;
+
+INSTANTIATE_REDUCTION(cl_int)
+INSTANTIATE_REDUCTION(cl_uint)
+INSTANTIATE_REDUCTION(cl_long)
+INSTANTIATE_REDUCTION(cl_ulong)
+INSTANTIATE_REDUCTION(cl_float)
+INSTANTIATE_REDUCTION(cl_double)
@@ -0,0 +1,385 @@
+#include "Base/Definitions.h"
+#include "Base/OpenCLManager.h"
+#include "Base/Utilities.h"
+#include "PrefixSum/SegmentedPrefixSum.h"
+
+#include <assert.h>
+#include <algorithm>
+
+template<typename T, typename Op>
+std::vector<T> SegmentedPrefixScan<T, Op>::CalculateCPU(const std::vector<T>& elements, const std::vector<cl_uint>& head_flags, ScanMode mode)
+{
+    assert(elements.size() == head_flags.size());
+
+    T sum = Op::template Identity<T>();
+
+    std::vector<T> prefix_sum;
+    prefix_sum.reserve(elements.size());
+
+    for (size_t i = 0; i < elements.size(); ++i)
+    {
+        if (head_flags[i])
+        {
+            sum = Op::template Identity<T>();
+        }
+
+        if (mode == ScanMode::Inclusive)
+        {
+            sum = Op::Apply(sum, elements[i]);
+            prefix_sum.push_back(sum);
+        }
+        else
+        {
+            prefix_sum.push_back(sum);
+            sum = Op::Apply(sum, elements[i]);
+        }
+    }
+
+    return prefix_sum;
+}
+
+template<typename T, typename Op>
+std::vector<cl_uint> SegmentedPrefixScan<T, Op>::OffsetsToHeadFlags(const std::vector<cl_uint>& segment_offsets, size_t num_elements)
+{
+    std::vector<cl_uint> head_flags(num_elements, 0);
+
+    for (cl_uint offset : segment_offsets)
+    {
+        if (offset < num_elements)
+        {
+            head_flags[offset] = 1;
+        }
+    }
+
+    return head_flags;
+}
+
+template<typename T, typename Op>
+SegmentedPrefixScan<T, Op>::SegmentedPrefixScan(size_t max_num_elements)
+{
+    Reserve(max_num_elements);
+}
+
+template<typename T, typename Op>
+SegmentedPrefixScan<T, Op>::~SegmentedPrefixScan()
+{
+    Release();
+}
+
+template<typename T, typename Op>
+void SegmentedPrefixScan<T, Op>::Reserve(size_t max_num_elements)
+{
+    // The level sizes depend on the tile size, so a changed configuration needs new buffers as well
+    size_t tile_size = GetTileSize();
+    if (max_num_elements <= capacity_ && tile_size == reserved_tile_size_)
+    {
+        return;
+    }
+
+    Release();
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    // Allocate buffer A & B and their flags
+    size_t next_multiple = Utility::GetNextMultipleOf(static_cast<uint32_t>(max_num_elements), static_cast<uint32_t>(tile_size));
+    input_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, next_multiple * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    input_flags_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    result_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    result_flags_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Allocate buffer C & D of each recursion level and their flags
+    size_t num_sub_arrays = 0;
+    do
+    {
+        num_sub_arrays = next_multiple / tile_size;
+        next_multiple = Utility::GetNextMultipleOf(static_cast<uint32_t>(num_sub_arrays), static_cast<uint32_t>(tile_size));
+
+        Level level;
+        level.c_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(T), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        level.fc_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_uint), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        level.d_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(T), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        level.fd_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, next_multiple * sizeof(cl_uint), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        levels_.push_back(level);
+    } while (num_sub_arrays > 1);
+
+    capacity_ = max_num_elements;
+    reserved_tile_size_ = tile_size;
+}
+
+template<typename T, typename Op>
+std::vector<T> SegmentedPrefixScan<T, Op>::Calculate(const std::vector<T>& elements, const std::vector<cl_uint>& head_flags)
+{
+    assert(elements.size() == head_flags.size());
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(elements.size());
+
+    // Fill buffer A & FA
+    cl_event write_events[2] = { 0, 0 };
+    status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, elements.size() * sizeof(T), elements.data(), 0, NULL, &write_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueWriteBuffer(mgr->command_queue, input_flags_buffer_, CL_FALSE, 0, head_flags.size() * sizeof(cl_uint), head_flags.data(), 1, &write_events[0], &write_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    std::vector<T> result = Calculate(elements.size(), write_events[1]);
+
+    for (cl_event write_event : write_events)
+    {
+        status = clReleaseEvent(write_event);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    return result;
+}
+
+template<typename T, typename Op>
+std::vector<T> SegmentedPrefixScan<T, Op>::CalculateByOffsets(const std::vector<T>& elements, const std::vector<cl_uint>& segment_offsets)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(elements.size());
+
+    // The offsets buffer is allocated even without segment offsets, the head flags kernel always needs a valid buffer
+    if (offsets_buffer_ == 0 || segment_offsets.size() > offsets_capacity_)
+    {
+        if (offsets_buffer_ != 0)
+        {
+            status = clReleaseMemObject(offsets_buffer_);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+
+        offsets_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, std::max(segment_offsets.size(), size_t(1)) * sizeof(cl_uint), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        offsets_capacity_ = std::max(segment_offsets.size(), size_t(1));
+    }
+
+    // Fill buffer A and the offsets, clear the flags
+    const cl_uint zero = 0;
+    cl_event write_events[3] = { 0, 0, 0 };
+    status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, elements.size() * sizeof(T), elements.data(), 0, NULL, &write_events[0]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clEnqueueFillBuffer(mgr->command_queue, input_flags_buffer_, &zero, sizeof(cl_uint), 0, elements.size() * sizeof(cl_uint), 0, NULL, &write_events[1]);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    size_t num_write_events = 2;
+    if (!segment_offsets.empty())
+    {
+        status = clEnqueueWriteBuffer(mgr->command_queue, offsets_buffer_, CL_FALSE, 0, segment_offsets.size() * sizeof(cl_uint), segment_offsets.data(), 0, NULL, &write_events[2]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        num_write_events = 3;
+    }
+
+    // Set the head flags
+    cl_uint num_segments_arg = static_cast<cl_uint>(segment_offsets.size());
+    cl_uint num_elements_arg = static_cast<cl_uint>(elements.size());
+    const cl_kernel kernel_head_flags = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_SEGMENT_HEAD_FLAGS, GetBuildOptions());
+    status = clSetKernelArg(kernel_head_flags, 0, sizeof(cl_mem), (void*)&offsets_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_head_flags, 1, sizeof(cl_mem), (void*)&input_flags_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_head_flags, 2, sizeof(cl_uint), &num_segments_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_head_flags, 3, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event head_flags_event = 0;
+    size_t global_work_size[1] = { Utility::GetNextMultipleOf(std::max(num_segments_arg, 1u), static_cast<uint32_t>(work_group_size)) };
+    size_t local_work_size[1] = { work_group_size };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_head_flags, 1, NULL, global_work_size, local_work_size, static_cast<cl_uint>(num_write_events), write_events, &head_flags_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    std::vector<T> result = Calculate(elements.size(), head_flags_event);
+
+    status = clReleaseEvent(head_flags_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    for (size_t i = 0; i < num_write_events; ++i)
+    {
+        status = clReleaseEvent(write_events[i]);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    return result;
+}
+
+template<typename T, typename Op>
+std::vector<T> SegmentedPrefixScan<T, Op>::Calculate(size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    cl_event scan_event = CalculateGPU_Recursive(0, input_buffer_, input_flags_buffer_, result_buffer_, result_flags_buffer_, num_elements, wait_event);
+
+    // Read result. This is the only blocking call of the scan.
+    std::vector<T> result(num_elements, 0);
+    status = clEnqueueReadBuffer(mgr->command_queue, result_buffer_, CL_TRUE, 0, num_elements * sizeof(T), result.data(), 1, &scan_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return result;
+}
+
+template<typename T, typename Op>
+cl_event SegmentedPrefixScan<T, Op>::CalculateGPU_Recursive(size_t level, cl_mem a_buffer, cl_mem fa_buffer, cl_mem b_buffer, cl_mem fb_buffer, size_t num_elements, cl_event wait_event)
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    assert(level < levels_.size());
+    cl_int status = 0;
+
+    size_t tile_size = GetTileSize();
+    size_t num_sub_arrays = Utility::GetNextMultipleOf(static_cast<uint32_t>(num_elements), static_cast<uint32_t>(tile_size)) / tile_size;
+
+    const Level& buffers = levels_[level];
+    cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+    cl_uint top_level_arg = level == 0 ? 1 : 0;
+
+    // Prepare segmented scan kernel
+    const cl_kernel kernel_segmented_scan = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_SUM_SEGMENTED, GetBuildOptions());
+    status = clSetKernelArg(kernel_segmented_scan, 0, sizeof(cl_mem), (void*)&a_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 1, sizeof(cl_mem), (void*)&fa_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 2, sizeof(cl_mem), (void*)&b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 3, sizeof(cl_mem), (void*)&fb_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 4, sizeof(cl_mem), (void*)&buffers.c_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 5, sizeof(cl_mem), (void*)&buffers.fc_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 6, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_segmented_scan, 7, sizeof(cl_uint), &top_level_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Run segmented scan kernel
+    cl_event scan_event = 0;
+    size_t global_work_size[1] = { num_sub_arrays * work_group_size };
+    size_t local_work_size[1] = { work_group_size };
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_segmented_scan, 1, NULL, global_work_size, local_work_size, 1, &wait_event, &scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    if (num_sub_arrays == 1)
+    {
+        return scan_event;
+    }
+
+    // Scan the (flag, sum) pairs of the sub arrays
+    cl_event sub_array_event = CalculateGPU_Recursive(level + 1, buffers.c_buffer, buffers.fc_buffer, buffers.d_buffer, buffers.fd_buffer, num_sub_arrays, scan_event);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Set kernel arguments.
+    const cl_kernel kernel_calc_e = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_CALC_E_SEGMENTED, GetBuildOptions());
+    status = clSetKernelArg(kernel_calc_e, 0, sizeof(cl_mem), (void*)&b_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_calc_e, 1, sizeof(cl_mem), (void*)&fb_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_calc_e, 2, sizeof(cl_mem), (void*)&buffers.d_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_calc_e, 3, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Run the kernel.
+    cl_event calc_e_event = 0;
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_calc_e, 1, NULL, global_work_size, local_work_size, 1, &sub_array_event, &calc_e_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(sub_array_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return calc_e_event;
+}
+
+template<typename T, typename Op>
+void SegmentedPrefixScan<T, Op>::Release()
+{
+    cl_int status = 0;
+
+    // Release buffers
+    for (Level& level : levels_)
+    {
+        for (cl_mem buffer : { level.c_buffer, level.fc_buffer, level.d_buffer, level.fd_buffer })
+        {
+            status = clReleaseMemObject(buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+    }
+    levels_.clear();
+
+    for (cl_mem* buffer : { &input_buffer_, &input_flags_buffer_, &result_buffer_, &result_flags_buffer_, &offsets_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            *buffer = 0;
+        }
+    }
+
+    offsets_capacity_ = 0;
+    capacity_ = 0;
+    reserved_tile_size_ = 0;
+}
+
+template<typename T, typename Op>
+size_t SegmentedPrefixScan<T, Op>::GetTileSize() const
+{
+    // The work group scan needs a power of two number of work items
+    assert(work_group_size > 0 && (work_group_size & (work_group_size - 1)) == 0);
+    assert(elements_per_work_item > 0);
+
+    return work_group_size * elements_per_work_item;
+}
+
+template<typename T, typename Op>
+std::string SegmentedPrefixScan<T, Op>::GetBuildOptions() const
+{
+    size_t log2_work_group_size = 0;
+    while ((size_t(1) << log2_work_group_size) < work_group_size)
+    {
+        ++log2_work_group_size;
+    }
+
+    std::string build_options = PrefixScan<T, Op>::GetTypeBuildOptions() +
+        " -DMAX_THREADS_PER_CU=" + std::to_string(work_group_size) +
+        " -DLOG2_MAX_THREADS_PER_CU=" + std::to_string(log2_work_group_size) +
+        " -DELEMENTS_PER_ITEM=" + std::to_string(elements_per_work_item);
+
+    // Only the top level of the segmented scan reads SCAN_INCLUSIVE, the levels below are selected by a kernel argument
+    if (mode == ScanMode::Inclusive)
+    {
+        build_options += " -DSCAN_INCLUSIVE";
+    }
+
+    return build_options;
+}
+
+// Explicit instantiations of all supported element types and operators
+#define INSTANTIATE_SEGMENTED_PREFIX_SCAN(T)                \
+    template class SegmentedPrefixScan<T, scan_op::Sum>;    \
+    template class SegmentedPrefixScan<T, scan_op::Max>;    \
+    template class SegmentedPrefixScan<T, scan_op::Min>;
+
+INSTANTIATE_SEGMENTED_PREFIX_SCAN(cl_int)
+INSTANTIATE_SEGMENTED_PREFIX_SCAN(cl_uint)
+INSTANTIATE_SEGMENTED_PREFIX_SCAN(cl_long)
+INSTANTIATE_SEGMENTED_PREFIX_SCAN(cl_ulong)
+INSTANTIATE_SEGMENTED_PREFIX_SCAN(cl_float)
+INSTANTIATE_SEGMENTED_PREFIX_SCAN(cl_double)
@@ -0,0 +1,192 @@
+#include "Base/Definitions.h"
+#include "Base/OpenCLManager.h"
+#include "Base/Utilities.h"
+#include "PrefixSum/StreamCompaction.h"
+
+#include <assert.h>
+
+template<typename T>
+std::vector<T> StreamCompaction<T>::CompactCPU(const std::vector<T>& elements, const std::function<bool(T)>& predicate)
+{
+    std::vector<T> result;
+    for (T element : elements)
+    {
+        if (predicate(element))
+        {
+            result.push_back(element);
+        }
+    }
+
+    return result;
+}
+
+template<typename T>
+StreamCompaction<T>::StreamCompaction(size_t max_num_elements)
+{
+    Reserve(max_num_elements);
+}
+
+template<typename T>
+StreamCompaction<T>::~StreamCompaction()
+{
+    Release();
+}
+
+template<typename T>
+void StreamCompaction<T>::Reserve(size_t max_num_elements)
+{
+    if (max_num_elements <= capacity_)
+    {
+        return;
+    }
+
+    Release();
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    input_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, max_num_elements * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    output_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, max_num_elements * sizeof(T), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    flags_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, max_num_elements * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    positions_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, max_num_elements * sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    count_buffer_ = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &status);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    scan_.Reserve(max_num_elements);
+    capacity_ = max_num_elements;
+}
+
+template<typename T>
+std::vector<T> StreamCompaction<T>::Compact(const std::vector<T>& elements, const std::string& predicate)
+{
+    if (elements.empty())
+    {
+        return {};
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(elements.size());
+
+    cl_event write_event = 0;
+    status = clEnqueueWriteBuffer(mgr->command_queue, input_buffer_, CL_FALSE, 0, elements.size() * sizeof(T), elements.data(), 0, NULL, &write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    size_t num_survivors = Compact(input_buffer_, elements.size(), predicate, output_buffer_, write_event);
+    status = clReleaseEvent(write_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // Only the survivors are read back
+    std::vector<T> result(num_survivors);
+    if (num_survivors > 0)
+    {
+        status = clEnqueueReadBuffer(mgr->command_queue, output_buffer_, CL_TRUE, 0, num_survivors * sizeof(T), result.data(), 0, NULL, NULL);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    }
+
+    return result;
+}
+
+template<typename T>
+size_t StreamCompaction<T>::Compact(cl_mem input_buffer, size_t num_elements, const std::string& predicate, cl_mem output_buffer, cl_event wait_event)
+{
+    if (num_elements == 0)
+    {
+        return 0;
+    }
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    assert(mgr != nullptr);
+    cl_int status = 0;
+
+    Reserve(num_elements);
+
+    // The predicate is compiled into the kernels as a function in front of the kernel file
+    std::string build_options = std::string("-DT=") + ScanType<T>::NAME;
+    std::string source_prefix = std::string("inline bool Predicate(T x) { return (") + predicate + "); }\n";
+    cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+    size_t global_work_size[1] = { Utility::GetNextMultipleOf(num_elements_arg, static_cast<uint32_t>(mpp::constants::MAX_THREADS_PER_CU)) };
+    size_t local_work_size[1] = { mpp::constants::MAX_THREADS_PER_CU };
+
+    // 1. Evaluate the predicate
+    const cl_kernel kernel_flags = mgr->GetKernel(mpp::filenames::KERNELS_STREAM_COMPACTION, mpp::kernels::COMPACT_FLAGS, build_options, source_prefix);
+    status = clSetKernelArg(kernel_flags, 0, sizeof(cl_mem), (void*)&input_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_flags, 1, sizeof(cl_mem), (void*)&flags_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_flags, 2, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event flags_event = 0;
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_flags, 1, NULL, global_work_size, local_work_size,
+        wait_event != 0 ? 1 : 0, wait_event != 0 ? &wait_event : NULL, &flags_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 2. Exclusive scan of the flags gives the output position of every survivor
+    cl_event scan_event = scan_.CalculateGPU(flags_buffer_, positions_buffer_, num_elements, flags_event);
+    status = clReleaseEvent(flags_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 3. Scatter the survivors
+    const cl_kernel kernel_scatter = mgr->GetKernel(mpp::filenames::KERNELS_STREAM_COMPACTION, mpp::kernels::COMPACT_SCATTER, build_options, source_prefix);
+    status = clSetKernelArg(kernel_scatter, 0, sizeof(cl_mem), (void*)&input_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 1, sizeof(cl_mem), (void*)&flags_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 2, sizeof(cl_mem), (void*)&positions_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 3, sizeof(cl_mem), (void*)&output_buffer);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 4, sizeof(cl_mem), (void*)&count_buffer_);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clSetKernelArg(kernel_scatter, 5, sizeof(cl_uint), &num_elements_arg);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    cl_event scatter_event = 0;
+    status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_scatter, 1, NULL, global_work_size, local_work_size, 1, &scan_event, &scatter_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scan_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    // 4. Read the number of survivors. This is the only blocking call.
+    cl_uint num_survivors = 0;
+    status = clEnqueueReadBuffer(mgr->command_queue, count_buffer_, CL_TRUE, 0, sizeof(cl_uint), &num_survivors, 1, &scatter_event, NULL);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(scatter_event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+    return num_survivors;
+}
+
+template<typename T>
+void StreamCompaction<T>::Release()
+{
+    cl_int status = 0;
+
+    for (cl_mem* buffer : { &input_buffer_, &output_buffer_, &flags_buffer_, &positions_buffer_, &count_buffer_ })
+    {
+        if (*buffer != 0)
+        {
+            status = clReleaseMemObject(*buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            *buffer = 0;
+        }
+    }
+
+    capacity_ = 0;
+}
+
+// Explicit instantiations of all supported element types
+template class StreamCompaction<cl_int>;
+template class StreamCompaction<cl_uint>;
+template class StreamCompaction<cl_long>;
+template class StreamCompaction<cl_ulong>;
+template class StreamCompaction<cl_float>;
+template class StreamCompaction<cl_double>;
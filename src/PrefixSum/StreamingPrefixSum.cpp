@@ -0,0 +1,141 @@
+#include "Base/Definitions.h"
+#include "Base/OpenCLManager.h"
+#include "PrefixSum/StreamingPrefixSum.h"
+
+#include <assert.h>
+#include <fstream>
+
+template<typename T, typename Op>
+StreamingPrefixScan<T, Op>::StreamingPrefixScan(size_t chunk_size)
+    : chunk_size_(chunk_size)
+{
+    assert(chunk_size_ > 0);
+
+    for (Slot& slot : slots_)
+    {
+        slot.scan.Reserve(chunk_size_);
+        slot.input.resize(chunk_size_);
+        slot.result.resize(chunk_size_);
+    }
+}
+
+template<typename T, typename Op>
+StreamingPrefixScan<T, Op>::~StreamingPrefixScan()
+{
+    for (Slot& slot : slots_)
+    {
+        if (slot.event != 0)
+        {
+            cl_int status = clWaitForEvents(1, &slot.event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            status = clReleaseEvent(slot.event);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        }
+    }
+}
+
+template<typename T, typename Op>
+T StreamingPrefixScan<T, Op>::Calculate(const ChunkReader& read_chunk, const ChunkWriter& write_chunk)
+{
+    T total = carry_in;
+
+    for (Slot& slot : slots_)
+    {
+        slot.scan.mode = mode;
+        slot.count = 0;
+    }
+
+    for (size_t chunk = 0; ; ++chunk)
+    {
+        Slot& slot = slots_[chunk % NUM_SLOTS];
+        Slot& previous = slots_[(chunk + 1) % NUM_SLOTS];
+
+        // 1. Read the next chunk while the device works on the previous one
+        slot.count = read_chunk(slot.input.data(), chunk_size_);
+
+        // 2. The running total after the previous chunk is the carry in of this one
+        Finish(previous, total);
+
+        // 3. Upload, scan and download without blocking, the kernels combine the running total with every result
+        if (slot.count > 0)
+        {
+            slot.scan.carry_in = total;
+            slot.event = slot.scan.Enqueue(slot.input.data(), slot.result.data(), slot.count);
+        }
+
+        // 4. Write the results of the previous chunk while the device works on this one
+        if (previous.count > 0)
+        {
+            write_chunk(previous.result.data(), previous.count);
+            previous.count = 0;
+        }
+
+        if (slot.count == 0)
+        {
+            break;
+        }
+    }
+
+    return total;
+}
+
+template<typename T, typename Op>
+void StreamingPrefixScan<T, Op>::Finish(Slot& slot, T& total)
+{
+    if (slot.event == 0)
+    {
+        return;
+    }
+
+    cl_int status = clWaitForEvents(1, &slot.event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    status = clReleaseEvent(slot.event);
+    assert(status == mpp::ReturnCode::CODE_SUCCESS);
+    slot.event = 0;
+
+    // The results already contain the running total: the last inclusive result, or the last exclusive result combined with the last element
+    total = slot.result[slot.count - 1];
+    if (mode == ScanMode::Exclusive)
+    {
+        total = Op::Apply(total, slot.input[slot.count - 1]);
+    }
+}
+
+template<typename T, typename Op>
+T StreamingPrefixScan<T, Op>::CalculateFile(const std::string& input_file_name, const std::string& output_file_name)
+{
+    std::ifstream input_file(input_file_name, std::ios::in | std::ios::binary);
+    assert(input_file.is_open());
+    std::ofstream output_file(output_file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+    assert(output_file.is_open());
+
+    return Calculate(
+        [&input_file](T* buffer, size_t max_count)
+        {
+            input_file.read(reinterpret_cast<char*>(buffer), max_count * sizeof(T));
+            return static_cast<size_t>(input_file.gcount()) / sizeof(T);
+        },
+        [&output_file](const T* results, size_t count)
+        {
+            output_file.write(reinterpret_cast<const char*>(results), count * sizeof(T));
+        });
+}
+
+template<typename T, typename Op>
+size_t StreamingPrefixScan<T, Op>::GetChunkSize() const
+{
+    return chunk_size_;
+}
+
+// Explicit instantiations of all supported element types and operators
+#define INSTANTIATE_STREAMING_PREFIX_SCAN(T)                \
+    template class StreamingPrefixScan<T, scan_op::Sum>;    \
+    template class StreamingPrefixScan<T, scan_op::Max>;    \
+    template class StreamingPrefixScan<T, scan_op::Min>;
+
+INSTANTIATE_STREAMING_PREFIX_SCAN(cl_int)
+INSTANTIATE_STREAMING_PREFIX_SCAN(cl_uint)
+INSTANTIATE_STREAMING_PREFIX_SCAN(cl_long)
+INSTANTIATE_STREAMING_PREFIX_SCAN(cl_ulong)
+INSTANTIATE_STREAMING_PREFIX_SCAN(cl_float)
+INSTANTIATE_STREAMING_PREFIX_SCAN(cl_double)
@@ -2,12 +2,22 @@
 #include "catch.hpp"
 
 #include "Base/Definitions.h"
+#include "Base/MappedArray.h"
 #include "Base/OpenCLManager.h"
 #include "Base/Utilities.h"
+#include "PrefixSum/Histogram.h"
 #include "PrefixSum/PrefixSum.h"
+#include "PrefixSum/RadixSort.h"
+#include "PrefixSum/Reduction.h"
+#include "PrefixSum/SegmentedPrefixSum.h"
+#include "PrefixSum/StreamCompaction.h"
+#include "PrefixSum/StreamingPrefixSum.h"
 
 #include <stdio.h>
+#include <fstream>
 #include <iostream>
+#include <random>
+#include <thread>
 
 TEST_CASE("PrefixSum CPU", "[cpu]")
 {
@@ -120,6 +130,78 @@ TEST_CASE("PrefixSum CPU", "[cpu]")
     };
 };
 
+TEST_CASE("PrefixSum CPU parallel", "[cpu]")
+{
+    using ScanMode = PrefixSum::ScanMode;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    Timer timer;
+
+    SECTION("Thread counts and sizes")
+    {
+        for (size_t size : { 0, 1, 7, 8, 9, 1'000, 65'536, 65'537, 1'000'003 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back((i % 13) - 6);
+            }
+
+            for (size_t num_threads : { 0, 1, 2, 3, 8 })
+            {
+                for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive })
+                {
+                    expected_output = PrefixSum::CalculateCPU(test_elements, mode, false, 5);
+                    REQUIRE(PrefixSum::CalculateCPUParallel(test_elements, num_threads, mode, 5) == expected_output);
+                }
+            }
+        }
+    };
+
+    SECTION("Element types and operators")
+    {
+        std::vector<cl_uint> uint_elements;
+        std::vector<cl_double> double_elements;
+        for (size_t i = 0; i < 500'000; ++i)
+        {
+            uint_elements.push_back(static_cast<cl_uint>(i * 2'654'435'761u));   // Wraps around
+            double_elements.push_back(static_cast<cl_double>((i * 37) % 1'000));
+        }
+
+        REQUIRE(PrefixScan<cl_uint>::CalculateCPUParallel(uint_elements, 4) == PrefixScan<cl_uint>::CalculateCPU(uint_elements));
+        REQUIRE(PrefixScan<cl_uint, scan_op::Max>::CalculateCPUParallel(uint_elements, 4) == PrefixScan<cl_uint, scan_op::Max>::CalculateCPU(uint_elements));
+        REQUIRE(PrefixScan<cl_double, scan_op::Min>::CalculateCPUParallel(double_elements, 4) == PrefixScan<cl_double, scan_op::Min>::CalculateCPU(double_elements));
+    };
+
+    for (size_t size : { 1'000'000, 10'000'000, 100'000'000 })
+    {
+        SECTION("Serial vs. parallel, size == " + std::to_string(size))
+        {
+            std::cout << "--------------- PrefixScan - CPU parallel, " << size << " elements --------------- " << std::endl;
+
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(1);
+            }
+
+            timer.Reset();
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+            std::cout << "Duration CPU: " << timer.GetElapsed() << " seconds" << std::endl;
+
+            for (size_t num_threads : { 1, 2, 4, 8, 0 })
+            {
+                timer.Reset();
+                std::vector<cl_int> test_prefix_sum = PrefixSum::CalculateCPUParallel(test_elements, num_threads);
+                std::cout << "Duration CPU parallel (threads=" << (num_threads == 0 ? std::thread::hardware_concurrency() : num_threads) << "): "
+                    << timer.GetElapsed() << " seconds" << std::endl;
+                REQUIRE(test_prefix_sum == expected_output);
+            }
+        };
+    }
+};
+
 TEST_CASE("PrefixSum Kernel Calculate e_buffer", "[kernel e_buffer]")
 {
     OpenCLManager* mgr = OpenCLManager::GetInstance();
@@ -457,3 +539,1639 @@ TEST_CASE("PrefixSum GPU", "[gpu]")
         std::cin.get();*/
     };
 };
+
+TEST_CASE("PrefixSum GPU persistent buffers", "[gpu]")
+{
+    Timer timer;
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    mgr->LoadKernel(mpp::filenames::KERNELS_PREFIX_SUM, { mpp::kernels::PREFIX_SUM, mpp::kernels::PREFIX_CALC_E });
+
+    const size_t num_runs = 10;
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    SECTION("Different sizes with one instance")
+    {
+        PrefixSum prefix_sum(1000);
+
+        for (size_t size : { 1000, 1, 256, 257, 999 })
+        {
+            test_elements = std::vector<cl_int>(size, 1);
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+            REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+        }
+
+        // Growing beyond the reserved size reallocates the buffers
+        test_elements = std::vector<cl_int>(70'000, 1);
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+        REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+    };
+
+    for (size_t size : { 1'000'000, 10'000'000 })
+    {
+        SECTION("Back-to-back scans, size == " + std::to_string(size))
+        {
+            std::cout << "--------------- PrefixScan - " << num_runs << "x " << size << " elements back-to-back --------------- " << std::endl;
+
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(i % 7);
+            }
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+
+            std::vector<cl_int> test_prefix_sum;
+            timer.Reset();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                test_prefix_sum = PrefixSum::CalculateGPU(test_elements);
+            }
+            std::cout << "Duration GPU (allocation per scan): " << timer.GetElapsed() / num_runs << " seconds per scan" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+
+            PrefixSum prefix_sum(size);
+            timer.Reset();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                test_prefix_sum = prefix_sum.Calculate(test_elements);
+            }
+            std::cout << "Duration GPU (persistent buffers): " << timer.GetElapsed() / num_runs << " seconds per scan" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+        };
+    }
+};
+
+TEST_CASE("PrefixSum GPU host blocking time", "[gpu]")
+{
+    Timer timer;
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    mgr->LoadKernel(mpp::filenames::KERNELS_PREFIX_SUM, { mpp::kernels::PREFIX_SUM, mpp::kernels::PREFIX_CALC_E });
+
+    const size_t num_runs = 10;
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    SECTION("Debug validation")
+    {
+        // Three recursion levels
+        for (cl_int i = 0; i < 100'000; ++i)
+        {
+            test_elements.push_back(i % 13 - 6);
+        }
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+
+        PrefixSum prefix_sum(test_elements.size());
+        prefix_sum.debug_validation = true;
+        REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+    };
+
+    for (size_t size : { 1'000'000, 10'000'000 })
+    {
+        SECTION("Blocking readbacks vs. event chain, size == " + std::to_string(size))
+        {
+            std::cout << "--------------- PrefixScan - host blocking time, " << size << " elements --------------- " << std::endl;
+
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(i % 7);
+            }
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+
+            PrefixSum prefix_sum(size);
+            std::vector<cl_int> test_prefix_sum;
+
+            // Blocking readbacks after every level
+            prefix_sum.debug_validation = true;
+            timer.Reset();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                test_prefix_sum = prefix_sum.Calculate(test_elements);
+            }
+            std::cout << "Host blocking time (blocking readbacks): " << timer.GetElapsed() / num_runs << " seconds per scan" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+
+            // Only the final read blocks
+            prefix_sum.debug_validation = false;
+            timer.Reset();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                test_prefix_sum = prefix_sum.Calculate(test_elements);
+            }
+            std::cout << "Host blocking time (event chain): " << timer.GetElapsed() / num_runs << " seconds per scan" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+        };
+    }
+};
+
+TEST_CASE("PrefixSum GPU single pass", "[gpu]")
+{
+    Timer timer;
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    mgr->LoadKernel(mpp::filenames::KERNELS_PREFIX_SUM, { mpp::kernels::PREFIX_SUM, mpp::kernels::PREFIX_CALC_E, mpp::kernels::PREFIX_SUM_SINGLE_PASS });
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    SECTION("Sizes around the tile size")
+    {
+        PrefixSum prefix_sum;
+        prefix_sum.algorithm = PrefixSum::Algorithm::SinglePass;
+
+        for (size_t size : { 1, 100, 255, 256, 257, 512, 1000 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(i);
+            }
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+            REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+        }
+    };
+
+    SECTION("val < 0, many tiles")
+    {
+        for (cl_int i = 0; i < 100'000; ++i)
+        {
+            test_elements.push_back(-(i % 100));
+        }
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+
+        REQUIRE(PrefixSum::CalculateGPU(test_elements, PrefixSum::Algorithm::SinglePass) == expected_output);
+    };
+
+    for (size_t size : { 1'000'000, 10'000'000 })
+    {
+        SECTION("Recursive vs. single pass, size == " + std::to_string(size))
+        {
+            std::cout << "--------------- PrefixScan - single pass, " << size << " elements --------------- " << std::endl;
+
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(i);
+            }
+
+            timer.Reset();
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+            std::cout << "Duration CPU: " << timer.GetElapsed() << " seconds" << std::endl;
+
+            PrefixSum prefix_sum(size);
+            prefix_sum.Calculate(test_elements);   // Warm up
+
+            timer.Reset();
+            std::vector<cl_int> test_prefix_sum = prefix_sum.Calculate(test_elements);
+            std::cout << "Duration GPU (recursive): " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+
+            prefix_sum.algorithm = PrefixSum::Algorithm::SinglePass;
+            timer.Reset();
+            test_prefix_sum = prefix_sum.Calculate(test_elements);
+            std::cout << "Duration GPU (single pass): " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+        };
+    }
+};
+
+TEST_CASE("PrefixSum GPU elements per work item", "[gpu]")
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    mgr->LoadKernel(mpp::filenames::KERNELS_PREFIX_SUM, { mpp::kernels::PREFIX_SUM, mpp::kernels::PREFIX_CALC_E, mpp::kernels::PREFIX_SUM_SINGLE_PASS });
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    Timer timer;
+
+    SECTION("Sizes around the tile size")
+    {
+        for (size_t elements_per_work_item : { 1, 2, 3, 4, 8 })
+        {
+            for (size_t work_group_size : { 64, 256 })
+            {
+                PrefixSum prefix_sum;
+                prefix_sum.elements_per_work_item = elements_per_work_item;
+                prefix_sum.work_group_size = work_group_size;
+
+                for (size_t size : { 1, 255, 256, 257, 1023, 1024, 1025, 100'000 })
+                {
+                    test_elements.clear();
+                    for (cl_int i = 0; i < size; ++i)
+                    {
+                        test_elements.push_back((i % 7) - 3);
+                    }
+                    expected_output = PrefixSum::CalculateCPU(test_elements);
+
+                    prefix_sum.algorithm = PrefixSum::Algorithm::Recursive;
+                    REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+
+                    prefix_sum.algorithm = PrefixSum::Algorithm::SinglePass;
+                    REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+                }
+            }
+        }
+    };
+
+    for (size_t size : { 1'000'000, 10'000'000 })
+    {
+        SECTION("Sweep elements per work item, size == " + std::to_string(size))
+        {
+            std::cout << "--------------- PrefixScan - elements per work item, " << size << " elements --------------- " << std::endl;
+
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(1);
+            }
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+
+            for (size_t elements_per_work_item : { 1, 2, 4, 8, 16 })
+            {
+                PrefixSum prefix_sum;
+                prefix_sum.elements_per_work_item = elements_per_work_item;
+                prefix_sum.Calculate(test_elements);   // Warm up, builds the kernel variant and allocates the buffers
+
+                timer.Reset();
+                std::vector<cl_int> test_prefix_sum = prefix_sum.Calculate(test_elements);
+                std::cout << "Duration GPU (K=" << elements_per_work_item << "): " << timer.GetElapsed() << " seconds" << std::endl;
+                REQUIRE(test_prefix_sum == expected_output);
+            }
+        };
+    }
+};
+
+TEST_CASE("PrefixSum Kernel conflict free offsets", "[kernel local phase]")
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+    cl_int status = 0;
+
+    SECTION("Padded scan")
+    {
+        for (size_t work_group_size : { 32, 64, 256 })
+        {
+            PrefixSum prefix_sum;
+            prefix_sum.conflict_free_offsets = true;
+            prefix_sum.work_group_size = work_group_size;
+
+            for (size_t size : { 1, 255, 256, 257, 100'000 })
+            {
+                test_elements.clear();
+                for (cl_int i = 0; i < size; ++i)
+                {
+                    test_elements.push_back((i % 5) - 1);
+                }
+                expected_output = PrefixSum::CalculateCPU(test_elements);
+
+                prefix_sum.algorithm = PrefixSum::Algorithm::Recursive;
+                REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+
+                prefix_sum.algorithm = PrefixSum::Algorithm::SinglePass;
+                REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+            }
+        }
+    };
+
+    SECTION("Local phase time, padded vs. unpadded")
+    {
+        std::cout << "--------------- PrefixScan - local phase of PrefixSum256 --------------- " << std::endl;
+
+        const size_t num_elements = 1 << 20;
+        const size_t num_runs = 10;
+
+        for (cl_int i = 0; i < num_elements; ++i)
+        {
+            test_elements.push_back(i % 3);
+        }
+
+        // Allocate buffers
+        cl_mem a_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_ONLY, num_elements * sizeof(cl_int), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        cl_mem b_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_elements * sizeof(cl_int), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        cl_mem c_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, num_elements / mpp::constants::MAX_THREADS_PER_CU * sizeof(cl_int), NULL, &status);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clEnqueueWriteBuffer(mgr->command_queue, a_buffer, CL_TRUE, 0, num_elements * sizeof(cl_int), test_elements.data(), 0, NULL, NULL);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        std::vector<std::vector<cl_int>> results;
+        for (const std::string build_options : { "", "-DCONFLICT_FREE_OFFSETS" })
+        {
+            // Set kernel args
+            const cl_kernel kernel_prefix_scan = mgr->GetKernel(mpp::filenames::KERNELS_PREFIX_SUM, mpp::kernels::PREFIX_SUM, build_options);
+            status = clSetKernelArg(kernel_prefix_scan, 0, sizeof(cl_mem), (void*)&a_buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            status = clSetKernelArg(kernel_prefix_scan, 1, sizeof(cl_mem), (void*)&b_buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            status = clSetKernelArg(kernel_prefix_scan, 2, sizeof(cl_mem), (void*)&c_buffer);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            cl_uint num_elements_arg = static_cast<cl_uint>(num_elements);
+            status = clSetKernelArg(kernel_prefix_scan, 3, sizeof(cl_uint), &num_elements_arg);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            cl_int carry_in = 0;
+            status = clSetKernelArg(kernel_prefix_scan, 4, sizeof(cl_int), &carry_in);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+            // Run the kernel and sum up the device time reported by event profiling
+            cl_ulong total_nanoseconds = 0;
+            for (size_t run = 0; run <= num_runs; ++run)
+            {
+                cl_event kernel_event = 0;
+                size_t global_work_size[1] = { num_elements };
+                size_t local_work_size[1] = { mpp::constants::MAX_THREADS_PER_CU };
+                status = clEnqueueNDRangeKernel(mgr->command_queue, kernel_prefix_scan, 1, NULL, global_work_size, local_work_size, 0, NULL, &kernel_event);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+                status = clWaitForEvents(1, &kernel_event);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+                cl_ulong time_start = 0;
+                cl_ulong time_end = 0;
+                status = clGetEventProfilingInfo(kernel_event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &time_start, NULL);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+                status = clGetEventProfilingInfo(kernel_event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &time_end, NULL);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+                status = clReleaseEvent(kernel_event);
+                assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+                // The first run is a warm up
+                if (run > 0)
+                {
+                    total_nanoseconds += time_end - time_start;
+                }
+            }
+
+            std::cout << "Duration PrefixSum256 (" << (build_options.empty() ? "unpadded" : "padded") << "): "
+                << total_nanoseconds / num_runs * 1e-9 << " seconds" << std::endl;
+
+            // Read results
+            std::vector<cl_int> result(num_elements, 0);
+            status = clEnqueueReadBuffer(mgr->command_queue, b_buffer, CL_TRUE, 0, num_elements * sizeof(cl_int), result.data(), 0, NULL, NULL);
+            assert(status == mpp::ReturnCode::CODE_SUCCESS);
+            results.push_back(result);
+        }
+
+        // release buffers
+        status = clReleaseMemObject(a_buffer);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clReleaseMemObject(b_buffer);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+        status = clReleaseMemObject(c_buffer);
+        assert(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        REQUIRE(results[0] == results[1]);
+    };
+};
+
+TEST_CASE("PrefixSum GPU subgroups", "[gpu]")
+{
+    Timer timer;
+
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    std::cout << "Sub groups " << (mgr->subgroups_supported ? "supported" : "not supported, falling back to the Blelloch scan") << std::endl;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    SECTION("Sizes around the tile size")
+    {
+        for (size_t work_group_size : { 64, 256 })
+        {
+            PrefixSum prefix_sum;
+            prefix_sum.work_group_size = work_group_size;
+            prefix_sum.elements_per_work_item = 2;
+
+            for (size_t size : { 1, 255, 256, 257, 100'000 })
+            {
+                test_elements.clear();
+                for (cl_int i = 0; i < size; ++i)
+                {
+                    test_elements.push_back((i % 9) - 4);
+                }
+                expected_output = PrefixSum::CalculateCPU(test_elements);
+
+                prefix_sum.algorithm = PrefixSum::Algorithm::Recursive;
+                REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+
+                prefix_sum.algorithm = PrefixSum::Algorithm::SinglePass;
+                REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+            }
+        }
+    };
+
+    SECTION("Sub groups vs. local memory tree, size == 1'000'000")
+    {
+        std::cout << "--------------- PrefixScan - sub group scan, 1'000'000 elements --------------- " << std::endl;
+
+        for (cl_int i = 0; i < 1'000'000; ++i)
+        {
+            test_elements.push_back(i % 3);
+        }
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+
+        for (bool use_subgroups : { false, true })
+        {
+            PrefixSum prefix_sum;
+            prefix_sum.use_subgroups = use_subgroups;
+            prefix_sum.Calculate(test_elements);   // Warm up
+
+            timer.Reset();
+            std::vector<cl_int> test_prefix_sum = prefix_sum.Calculate(test_elements);
+            std::cout << "Duration GPU (" << (use_subgroups && mgr->subgroups_supported ? "sub groups" : "local memory tree") << "): " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+        }
+    };
+};
+
+TEST_CASE("PrefixScan GPU element types and operators", "[gpu]")
+{
+    const size_t num_elements = 100'000;
+
+    SECTION("cl_long sum above 2^31")
+    {
+        std::vector<cl_long> test_elements(num_elements, 1ll << 20);
+        std::vector<cl_long> expected_output = PrefixScan<cl_long>::CalculateCPU(test_elements);
+        REQUIRE(expected_output.back() > std::numeric_limits<cl_int>::max());
+
+        REQUIRE(PrefixScan<cl_long>::CalculateGPU(test_elements) == expected_output);
+        REQUIRE(PrefixScan<cl_long>::CalculateGPU(test_elements, PrefixScan<cl_long>::Algorithm::SinglePass) == expected_output);
+    };
+
+    SECTION("cl_uint sum")
+    {
+        std::vector<cl_uint> test_elements;
+        for (cl_uint i = 0; i < num_elements; ++i)
+        {
+            test_elements.push_back(i * 2654435761u);
+        }
+        std::vector<cl_uint> expected_output = PrefixScan<cl_uint>::CalculateCPU(test_elements);
+
+        REQUIRE(PrefixScan<cl_uint>::CalculateGPU(test_elements) == expected_output);
+    };
+
+    SECTION("cl_float and cl_double sum")
+    {
+        std::vector<cl_float> float_elements;
+        std::vector<cl_double> double_elements;
+        for (size_t i = 0; i < num_elements; ++i)
+        {
+            float_elements.push_back(0.25f * (i % 8));
+            double_elements.push_back(0.1 * (i % 10));
+        }
+
+        // Exactly representable partial sums, so the order of the additions doesn't matter
+        REQUIRE(PrefixScan<cl_float>::CalculateGPU(float_elements) == PrefixScan<cl_float>::CalculateCPU(float_elements));
+
+        std::vector<cl_double> expected_output = PrefixScan<cl_double>::CalculateCPU(double_elements);
+        std::vector<cl_double> test_prefix_sum = PrefixScan<cl_double>::CalculateGPU(double_elements);
+        REQUIRE(test_prefix_sum.size() == expected_output.size());
+        for (size_t i = 0; i < expected_output.size(); ++i)
+        {
+            REQUIRE(std::abs(test_prefix_sum[i] - expected_output[i]) <= 1e-6 * std::max(1.0, expected_output[i]));
+        }
+    };
+
+    SECTION("Max and min scans")
+    {
+        std::vector<cl_int> int_elements;
+        std::vector<cl_float> float_elements;
+        for (size_t i = 0; i < num_elements; ++i)
+        {
+            int_elements.push_back(static_cast<cl_int>((i * 7919) % 100'003) - 50'000);
+            float_elements.push_back(static_cast<cl_float>(int_elements.back()) * 0.5f);
+        }
+
+        REQUIRE(PrefixScan<cl_int, scan_op::Max>::CalculateGPU(int_elements) == PrefixScan<cl_int, scan_op::Max>::CalculateCPU(int_elements));
+        REQUIRE(PrefixScan<cl_int, scan_op::Min>::CalculateGPU(int_elements) == PrefixScan<cl_int, scan_op::Min>::CalculateCPU(int_elements));
+        REQUIRE(PrefixScan<cl_float, scan_op::Max>::CalculateGPU(float_elements) == PrefixScan<cl_float, scan_op::Max>::CalculateCPU(float_elements));
+
+        PrefixScan<cl_float, scan_op::Min> min_scan;
+        min_scan.algorithm = PrefixScan<cl_float, scan_op::Min>::Algorithm::SinglePass;
+        min_scan.elements_per_work_item = 4;
+        REQUIRE(min_scan.Calculate(float_elements) == PrefixScan<cl_float, scan_op::Min>::CalculateCPU(float_elements));
+    };
+};
+
+TEST_CASE("PrefixScan GPU scan modes", "[gpu]")
+{
+    using Algorithm = PrefixSum::Algorithm;
+    using ScanMode = PrefixSum::ScanMode;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    SECTION("Inclusive, reverse and carry-in")
+    {
+        for (size_t size : { 1, 255, 256, 257, 100'000 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back((i % 11) - 5);
+            }
+
+            for (Algorithm algorithm : { Algorithm::Recursive, Algorithm::SinglePass })
+            {
+                for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive })
+                {
+                    for (bool reverse : { false, true })
+                    {
+                        PrefixSum prefix_sum;
+                        prefix_sum.algorithm = algorithm;
+                        prefix_sum.mode = mode;
+                        prefix_sum.reverse = reverse;
+                        prefix_sum.carry_in = 42;
+                        prefix_sum.elements_per_work_item = 2;
+
+                        expected_output = PrefixSum::CalculateCPU(test_elements, mode, reverse, 42);
+                        REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+                    }
+                }
+            }
+        }
+    };
+
+    SECTION("Inclusive max scan")
+    {
+        std::vector<cl_float> float_elements;
+        for (size_t i = 0; i < 10'000; ++i)
+        {
+            float_elements.push_back(static_cast<cl_float>((i * 37) % 1'000));
+        }
+
+        PrefixScan<cl_float, scan_op::Max> max_scan;
+        max_scan.mode = PrefixScan<cl_float, scan_op::Max>::ScanMode::Inclusive;
+        REQUIRE(max_scan.Calculate(float_elements) == PrefixScan<cl_float, scan_op::Max>::CalculateCPU(float_elements, PrefixScan<cl_float, scan_op::Max>::ScanMode::Inclusive));
+    };
+
+    SECTION("Chunked scan with carry-in")
+    {
+        for (cl_int i = 0; i < 100'000; ++i)
+        {
+            test_elements.push_back(i % 100);
+        }
+        expected_output = PrefixSum::CalculateCPU(test_elements, ScanMode::Inclusive);
+
+        // Scan chunks of 30'000 elements, every chunk continues at the last result of the previous chunk
+        PrefixSum prefix_sum(30'000);
+        prefix_sum.mode = ScanMode::Inclusive;
+
+        std::vector<cl_int> result;
+        for (size_t offset = 0; offset < test_elements.size(); offset += 30'000)
+        {
+            std::vector<cl_int> chunk(test_elements.begin() + offset, test_elements.begin() + std::min(offset + 30'000, test_elements.size()));
+            std::vector<cl_int> chunk_result = prefix_sum.Calculate(chunk);
+            prefix_sum.carry_in = chunk_result.back();
+            result.insert(result.end(), chunk_result.begin(), chunk_result.end());
+        }
+
+        REQUIRE(result == expected_output);
+    };
+
+    SECTION("Debug validation with carry-in")
+    {
+        for (cl_int i = 0; i < 100'000; ++i)
+        {
+            test_elements.push_back(1);
+        }
+
+        PrefixSum prefix_sum;
+        prefix_sum.debug_validation = true;
+        prefix_sum.carry_in = 7;
+        REQUIRE(prefix_sum.Calculate(test_elements) == PrefixSum::CalculateCPU(test_elements, ScanMode::Exclusive, false, 7));
+    };
+};
+
+TEST_CASE("PrefixSum GPU load and store transforms", "[gpu]")
+{
+    using Algorithm = PrefixSum::Algorithm;
+    using ScanMode = PrefixSum::ScanMode;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+    Timer timer;
+
+    SECTION("Predicate to offsets")
+    {
+        // Single tile, several tiles and several recursion levels
+        for (size_t size : { 1, 255, 256, 257, 100'000 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back((i % 11) - 5);
+            }
+
+            std::vector<cl_int> flags;
+            for (cl_int element : test_elements)
+            {
+                flags.push_back(element > 0 ? 1 : 0);
+            }
+
+            for (Algorithm algorithm : { Algorithm::Recursive, Algorithm::SinglePass })
+            {
+                for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive })
+                {
+                    PrefixSum prefix_sum;
+                    prefix_sum.algorithm = algorithm;
+                    prefix_sum.mode = mode;
+                    prefix_sum.carry_in = 3;
+                    prefix_sum.load_transform = "x > 0 ? 1 : 0";
+                    prefix_sum.store_transform = "x * 4";
+
+                    expected_output = PrefixSum::CalculateCPU(flags, mode, false, 3);
+                    for (cl_int& result : expected_output)
+                    {
+                        result *= 4;
+                    }
+                    REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+                }
+            }
+        }
+    };
+
+    SECTION("Only one transform")
+    {
+        for (cl_int i = 0; i < 10'000; ++i)
+        {
+            test_elements.push_back(i % 7);
+        }
+
+        PrefixSum load_only;
+        load_only.load_transform = "x * x";
+        std::vector<cl_int> squares;
+        for (cl_int element : test_elements)
+        {
+            squares.push_back(element * element);
+        }
+        REQUIRE(load_only.Calculate(test_elements) == PrefixSum::CalculateCPU(squares));
+
+        PrefixSum store_only;
+        store_only.store_transform = "-x";
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+        for (cl_int& result : expected_output)
+        {
+            result = -result;
+        }
+        REQUIRE(store_only.Calculate(test_elements) == expected_output);
+    };
+
+    SECTION("Fused vs. separate passes, size == 10000000")
+    {
+        std::cout << "--------------- PrefixSum transforms - 10000000 elements --------------- " << std::endl;
+
+        for (cl_int i = 0; i < 10'000'000; ++i)
+        {
+            test_elements.push_back(i % 100);
+        }
+
+        // Previous approach: map on the host, scan, map on the host
+        PrefixSum prefix_sum(test_elements.size());
+        prefix_sum.Calculate(test_elements);   // Warm up, builds the kernels
+        timer.Reset();
+        std::vector<cl_int> flags(test_elements.size());
+        for (size_t i = 0; i < test_elements.size(); ++i)
+        {
+            flags[i] = test_elements[i] < 10 ? 1 : 0;
+        }
+        expected_output = prefix_sum.Calculate(flags);
+        for (cl_int& result : expected_output)
+        {
+            result *= 4;
+        }
+        std::cout << "Duration host map + GPU scan + host map: " << timer.GetElapsed() << " seconds" << std::endl;
+
+        PrefixSum fused_prefix_sum(test_elements.size());
+        fused_prefix_sum.load_transform = "x < 10 ? 1 : 0";
+        fused_prefix_sum.store_transform = "x * 4";
+        fused_prefix_sum.Calculate(test_elements);   // Warm up, builds the kernels
+        timer.Reset();
+        std::vector<cl_int> result = fused_prefix_sum.Calculate(test_elements);
+        std::cout << "Duration GPU fused scan: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(result == expected_output);
+    };
+};
+
+TEST_CASE("PrefixSum GPU batched", "[gpu]")
+{
+    using ScanMode = PrefixSum::ScanMode;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_uint> array_offsets;
+    std::vector<cl_int> expected_output;
+
+    Timer timer;
+    std::mt19937 generator(42);
+
+    // Packs num_arrays arrays of min_size to max_size elements
+    auto fill_batch = [&](size_t num_arrays, size_t min_size, size_t max_size)
+    {
+        test_elements.clear();
+        array_offsets.clear();
+        for (size_t array = 0; array < num_arrays; ++array)
+        {
+            array_offsets.push_back(static_cast<cl_uint>(test_elements.size()));
+            size_t size = min_size + generator() % (max_size - min_size + 1);
+            for (size_t i = 0; i < size; ++i)
+            {
+                test_elements.push_back(static_cast<cl_int>(generator() % 21) - 10);
+            }
+        }
+    };
+
+    // Scans every array on its own
+    auto calculate_batch_cpu = [&](ScanMode mode, bool reverse, cl_int carry_in)
+    {
+        std::vector<cl_int> result;
+        for (size_t array = 0; array < array_offsets.size(); ++array)
+        {
+            size_t end = array + 1 < array_offsets.size() ? array_offsets[array + 1] : test_elements.size();
+            std::vector<cl_int> elements(test_elements.begin() + array_offsets[array], test_elements.begin() + end);
+            std::vector<cl_int> array_result = PrefixSum::CalculateCPU(elements, mode, reverse, carry_in);
+            result.insert(result.end(), array_result.begin(), array_result.end());
+        }
+        return result;
+    };
+
+    SECTION("Array sizes, modes and carry-in")
+    {
+        // Empty arrays, arrays below, at and above the tile size
+        fill_batch(200, 0, 1'000);
+        array_offsets.push_back(static_cast<cl_uint>(test_elements.size()));    // Empty last array
+
+        for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive })
+        {
+            for (bool reverse : { false, true })
+            {
+                for (size_t elements_per_work_item : { 1, 4 })
+                {
+                    PrefixSum prefix_sum;
+                    prefix_sum.mode = mode;
+                    prefix_sum.reverse = reverse;
+                    prefix_sum.carry_in = 7;
+                    prefix_sum.elements_per_work_item = elements_per_work_item;
+
+                    REQUIRE(prefix_sum.CalculateBatch(test_elements, array_offsets) == calculate_batch_cpu(mode, reverse, 7));
+                }
+            }
+        }
+    };
+
+    SECTION("Batch vs. segmented scan")
+    {
+        fill_batch(50, 100, 10'000);
+
+        PrefixSum prefix_sum;
+        SegmentedPrefixSum segmented_prefix_sum;
+        REQUIRE(prefix_sum.CalculateBatch(test_elements, array_offsets) == segmented_prefix_sum.CalculateByOffsets(test_elements, array_offsets));
+    };
+
+    SECTION("Batch vs. loop of calls, 2000 arrays of 100 - 10000 elements")
+    {
+        std::cout << "--------------- PrefixSum batched - 2000 arrays --------------- " << std::endl;
+
+        fill_batch(2'000, 100, 10'000);
+        expected_output = calculate_batch_cpu(ScanMode::Exclusive, false, 0);
+
+        // Previous approach: one scan per array
+        PrefixSum prefix_sum;
+        prefix_sum.Reserve(10'000);
+        prefix_sum.Calculate(std::vector<cl_int>(10'000, 1));   // Warm up, builds the kernels
+        timer.Reset();
+        std::vector<cl_int> loop_result;
+        for (size_t array = 0; array < array_offsets.size(); ++array)
+        {
+            size_t end = array + 1 < array_offsets.size() ? array_offsets[array + 1] : test_elements.size();
+            std::vector<cl_int> array_result = prefix_sum.Calculate(std::vector<cl_int>(test_elements.begin() + array_offsets[array], test_elements.begin() + end));
+            loop_result.insert(loop_result.end(), array_result.begin(), array_result.end());
+        }
+        std::cout << "Duration loop of calls: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(loop_result == expected_output);
+
+        PrefixSum batch_prefix_sum(test_elements.size());
+        batch_prefix_sum.CalculateBatch(test_elements, array_offsets);     // Warm up, builds the kernel
+        timer.Reset();
+        std::vector<cl_int> batch_result = batch_prefix_sum.CalculateBatch(test_elements, array_offsets);
+        std::cout << "Duration batched: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(batch_result == expected_output);
+    };
+};
+
+TEST_CASE("PrefixSum GPU asynchronous", "[gpu]")
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    cl_int status = 0;
+
+    Timer timer;
+
+    // Batch number batch of size elements
+    auto make_batch = [](size_t batch, size_t size)
+    {
+        std::vector<cl_int> elements(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            elements[i] = static_cast<cl_int>((i * 7 + batch) % 13) - 6;
+        }
+        return elements;
+    };
+
+    SECTION("Futures of several producer threads")
+    {
+        using Algorithm = PrefixSum::Algorithm;
+        for (Algorithm algorithm : { Algorithm::Recursive, Algorithm::SinglePass })
+        {
+            PrefixSum prefix_sum;
+            prefix_sum.algorithm = algorithm;
+            prefix_sum.mode = PrefixSum::ScanMode::Inclusive;
+
+            const size_t num_threads = 4;
+            const size_t batches_per_thread = 8;
+            std::vector<std::vector<std::future<std::vector<cl_int>>>> futures(num_threads);
+            std::vector<std::thread> producers;
+            for (size_t thread = 0; thread < num_threads; ++thread)
+            {
+                producers.emplace_back([&, thread]()
+                {
+                    for (size_t batch = 0; batch < batches_per_thread; ++batch)
+                    {
+                        futures[thread].push_back(prefix_sum.CalculateGPUAsync(make_batch(thread * batches_per_thread + batch, 1'000 + batch * 10'000)));
+                    }
+                });
+            }
+            for (std::thread& producer : producers)
+            {
+                producer.join();
+            }
+
+            // A synchronous scan while the asynchronous ones are still in flight waits for them
+            std::vector<cl_int> sync_elements = make_batch(num_threads * batches_per_thread, 50'000);
+            REQUIRE(prefix_sum.Calculate(sync_elements) == PrefixSum::CalculateCPU(sync_elements, PrefixSum::ScanMode::Inclusive));
+
+            for (size_t thread = 0; thread < num_threads; ++thread)
+            {
+                for (size_t batch = 0; batch < batches_per_thread; ++batch)
+                {
+                    std::vector<cl_int> elements = make_batch(thread * batches_per_thread + batch, 1'000 + batch * 10'000);
+                    REQUIRE(futures[thread][batch].get() == PrefixSum::CalculateCPU(elements, PrefixSum::ScanMode::Inclusive));
+                }
+            }
+
+            REQUIRE(prefix_sum.CalculateGPUAsync({}).get().empty());
+        }
+    };
+
+    SECTION("Device resident buffers")
+    {
+        std::vector<cl_int> elements = make_batch(0, 100'000);
+        cl_mem a_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, elements.size() * sizeof(cl_int), NULL, &status);
+        REQUIRE(status == mpp::ReturnCode::CODE_SUCCESS);
+        cl_mem b_buffer = clCreateBuffer(mgr->context, CL_MEM_READ_WRITE, elements.size() * sizeof(cl_int), NULL, &status);
+        REQUIRE(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        cl_event write_event = 0;
+        status = clEnqueueWriteBuffer(mgr->command_queue, a_buffer, CL_FALSE, 0, elements.size() * sizeof(cl_int), elements.data(), 0, NULL, &write_event);
+        REQUIRE(status == mpp::ReturnCode::CODE_SUCCESS);
+
+        // Scan of the scan, both stay on the device
+        PrefixSum prefix_sum;
+        cl_event first_event = prefix_sum.CalculateGPUAsync(a_buffer, b_buffer, elements.size(), write_event);
+        cl_event second_event = prefix_sum.CalculateGPUAsync(b_buffer, a_buffer, elements.size(), first_event);
+
+        std::vector<cl_int> result(elements.size());
+        status = clEnqueueReadBuffer(mgr->command_queue, a_buffer, CL_TRUE, 0, result.size() * sizeof(cl_int), result.data(), 1, &second_event, NULL);
+        REQUIRE(status == mpp::ReturnCode::CODE_SUCCESS);
+        REQUIRE(result == PrefixSum::CalculateCPU(PrefixSum::CalculateCPU(elements)));
+
+        for (cl_event event : { write_event, first_event, second_event })
+        {
+            clReleaseEvent(event);
+        }
+        clReleaseMemObject(a_buffer);
+        clReleaseMemObject(b_buffer);
+    };
+
+    SECTION("Pipelining, 16 batches of 1000000 elements")
+    {
+        std::cout << "--------------- PrefixSum asynchronous - 16 batches --------------- " << std::endl;
+
+        const size_t num_batches = 16;
+        const size_t batch_size = 1'000'000;
+
+        PrefixSum prefix_sum(batch_size);
+        prefix_sum.Calculate(make_batch(0, batch_size));    // Warm up, builds the kernels
+
+        // Host preparation and device scan one after another
+        timer.Reset();
+        std::vector<std::vector<cl_int>> sync_results;
+        for (size_t batch = 0; batch < num_batches; ++batch)
+        {
+            sync_results.push_back(prefix_sum.Calculate(make_batch(batch, batch_size)));
+        }
+        std::cout << "Duration synchronous: " << timer.GetElapsed() << " seconds" << std::endl;
+
+        // The next batch is prepared while the previous ones are scanned
+        timer.Reset();
+        std::vector<std::future<std::vector<cl_int>>> futures;
+        for (size_t batch = 0; batch < num_batches; ++batch)
+        {
+            futures.push_back(prefix_sum.CalculateGPUAsync(make_batch(batch, batch_size)));
+        }
+        std::vector<std::vector<cl_int>> async_results;
+        for (std::future<std::vector<cl_int>>& future : futures)
+        {
+            async_results.push_back(future.get());
+        }
+        std::cout << "Duration asynchronous: " << timer.GetElapsed() << " seconds" << std::endl;
+
+        REQUIRE(async_results == sync_results);
+    };
+};
+
+TEST_CASE("SegmentedPrefixSum GPU", "[gpu]")
+{
+    using ScanMode = SegmentedPrefixSum::ScanMode;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_uint> segment_offsets;
+    std::vector<cl_uint> head_flags;
+
+    // Random segment lengths between 1 and max_segment_length, the first segment starts at element 0
+    std::mt19937 generator(42);
+    auto make_segments = [&](size_t size, cl_uint max_segment_length)
+    {
+        std::uniform_int_distribution<cl_uint> length_distribution(1, max_segment_length);
+        std::uniform_int_distribution<cl_int> value_distribution(-100, 100);
+
+        test_elements.clear();
+        segment_offsets.clear();
+        for (size_t i = 0; i < size; ++i)
+        {
+            test_elements.push_back(value_distribution(generator));
+        }
+        for (cl_uint offset = 0; offset < size; offset += length_distribution(generator))
+        {
+            segment_offsets.push_back(offset);
+        }
+        head_flags = SegmentedPrefixSum::OffsetsToHeadFlags(segment_offsets, size);
+    };
+
+    SECTION("Random segment lengths")
+    {
+        for (size_t size : { 1, 255, 256, 257, 65'537, 1'000'000 })
+        {
+            for (cl_uint max_segment_length : { 1, 7, 300, 100'000 })
+            {
+                make_segments(size, max_segment_length);
+
+                for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive })
+                {
+                    SegmentedPrefixSum segmented_scan;
+                    segmented_scan.mode = mode;
+
+                    std::vector<cl_int> expected_output = SegmentedPrefixSum::CalculateCPU(test_elements, head_flags, mode);
+                    REQUIRE(segmented_scan.Calculate(test_elements, head_flags) == expected_output);
+                    REQUIRE(segmented_scan.CalculateByOffsets(test_elements, segment_offsets) == expected_output);
+                }
+            }
+        }
+    };
+
+    SECTION("Elements per work item")
+    {
+        make_segments(300'000, 500);
+        std::vector<cl_int> expected_output = SegmentedPrefixSum::CalculateCPU(test_elements, head_flags);
+
+        SegmentedPrefixSum segmented_scan;
+        for (size_t elements_per_work_item : { 1, 2, 4, 8 })
+        {
+            segmented_scan.elements_per_work_item = elements_per_work_item;
+            REQUIRE(segmented_scan.CalculateByOffsets(test_elements, segment_offsets) == expected_output);
+        }
+    };
+
+    SECTION("No segment offsets")
+    {
+        make_segments(10'000, 1);
+        segment_offsets.clear();
+
+        // Without offsets the whole array is one segment
+        SegmentedPrefixSum segmented_scan;
+        REQUIRE(segmented_scan.CalculateByOffsets(test_elements, segment_offsets) == PrefixSum::CalculateCPU(test_elements));
+    };
+
+    SECTION("Segmented max scan")
+    {
+        make_segments(100'000, 1'000);
+        std::vector<cl_float> float_elements(test_elements.begin(), test_elements.end());
+
+        using MaxScan = SegmentedPrefixScan<cl_float, scan_op::Max>;
+        MaxScan max_scan;
+        max_scan.mode = MaxScan::ScanMode::Inclusive;
+        REQUIRE(max_scan.Calculate(float_elements, head_flags) == MaxScan::CalculateCPU(float_elements, head_flags, MaxScan::ScanMode::Inclusive));
+    };
+};
+
+TEST_CASE("PrefixSum GPU zero copy", "[gpu]")
+{
+    using Algorithm = PrefixSum::Algorithm;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    Timer timer;
+
+    SECTION("Aligned allocator")
+    {
+        AlignedVector<cl_int> aligned_elements(1'000);
+        REQUIRE(reinterpret_cast<uintptr_t>(aligned_elements.data()) % mpp::constants::ZERO_COPY_ALIGNMENT == 0);
+
+        AlignedVector<cl_double> aligned_doubles(3);
+        REQUIRE(reinterpret_cast<uintptr_t>(aligned_doubles.data()) % mpp::constants::ZERO_COPY_ALIGNMENT == 0);
+    };
+
+    SECTION("Mapped and host pointer buffers")
+    {
+        for (size_t size : { 1, 255, 256, 257, 100'000 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back((i % 9) - 4);
+            }
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+            AlignedVector<cl_int> aligned_elements(test_elements.begin(), test_elements.end());
+
+            for (Algorithm algorithm : { Algorithm::Recursive, Algorithm::SinglePass })
+            {
+                PrefixSum prefix_sum;
+                prefix_sum.algorithm = algorithm;
+                prefix_sum.zero_copy = true;
+                REQUIRE(prefix_sum.Calculate(test_elements) == expected_output);
+
+                AlignedVector<cl_int> aligned_result;
+                prefix_sum.Calculate(aligned_elements, aligned_result);
+                REQUIRE(std::vector<cl_int>(aligned_result.begin(), aligned_result.end()) == expected_output);
+            }
+        }
+    };
+
+    for (size_t size : { 1'000'000, 10'000'000 })
+    {
+        SECTION("Copy vs. zero copy, size == " + std::to_string(size))
+        {
+            std::cout << "--------------- PrefixScan - zero copy, " << size << " elements --------------- " << std::endl;
+
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back(1);
+            }
+            expected_output = PrefixSum::CalculateCPU(test_elements);
+            AlignedVector<cl_int> aligned_elements(test_elements.begin(), test_elements.end());
+            AlignedVector<cl_int> aligned_result;
+
+            // Effective bandwidth: every element is read once from the input and written once to the result
+            double gigabytes = 2.0 * size * sizeof(cl_int) / 1e9;
+
+            PrefixSum prefix_sum(size);
+            prefix_sum.Calculate(test_elements);    // Warm up, builds the kernels
+
+            timer.Reset();
+            std::vector<cl_int> test_prefix_sum = prefix_sum.Calculate(test_elements);
+            double elapsed = timer.GetElapsed();
+            std::cout << "Duration GPU (write/read): " << elapsed << " seconds, " << gigabytes / elapsed << " GB/s" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+
+            prefix_sum.zero_copy = true;
+            prefix_sum.Calculate(test_elements);    // Reallocates A & B in host memory
+
+            timer.Reset();
+            test_prefix_sum = prefix_sum.Calculate(test_elements);
+            elapsed = timer.GetElapsed();
+            std::cout << "Duration GPU (map/unmap): " << elapsed << " seconds, " << gigabytes / elapsed << " GB/s" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+
+            timer.Reset();
+            prefix_sum.Calculate(aligned_elements, aligned_result);
+            elapsed = timer.GetElapsed();
+            std::cout << "Duration GPU (host pointer): " << elapsed << " seconds, " << gigabytes / elapsed << " GB/s" << std::endl;
+            REQUIRE(std::vector<cl_int>(aligned_result.begin(), aligned_result.end()) == expected_output);
+        };
+    }
+};
+
+TEST_CASE("StreamingPrefixSum GPU", "[gpu]")
+{
+    using ScanMode = StreamingPrefixSum::ScanMode;
+
+    std::vector<cl_int> test_elements;
+    std::vector<cl_int> expected_output;
+
+    Timer timer;
+
+    SECTION("Chunk sizes")
+    {
+        for (size_t size : { 1, 999, 1'000, 1'001, 123'457 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back((i % 17) - 8);
+            }
+
+            for (size_t chunk_size : { 1, 256, 1'000, 50'000 })
+            {
+                if (chunk_size == 1 && size > 1'000)
+                {
+                    continue;
+                }
+
+                for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive })
+                {
+                    StreamingPrefixSum streaming_scan(chunk_size);
+                    streaming_scan.mode = mode;
+                    streaming_scan.carry_in = 3;
+
+                    std::vector<cl_int> result;
+                    streaming_scan.Calculate(test_elements.begin(), test_elements.end(), std::back_inserter(result));
+                    REQUIRE(result == PrefixSum::CalculateCPU(test_elements, mode, false, 3));
+                }
+            }
+        }
+    };
+
+    SECTION("Total and operators")
+    {
+        std::vector<cl_float> float_elements;
+        for (size_t i = 0; i < 100'000; ++i)
+        {
+            float_elements.push_back(static_cast<cl_float>((i * 7'919) % 10'007));
+        }
+
+        StreamingPrefixScan<cl_float, scan_op::Max> max_scan(4'096);
+        std::vector<cl_float> result;
+        cl_float total = max_scan.Calculate(
+            [&float_elements, offset = size_t(0)](cl_float* buffer, size_t max_count) mutable
+            {
+                size_t count = std::min(max_count, float_elements.size() - offset);
+                std::copy(float_elements.begin() + offset, float_elements.begin() + offset + count, buffer);
+                offset += count;
+                return count;
+            },
+            [&result](const cl_float* results, size_t count)
+            {
+                result.insert(result.end(), results, results + count);
+            });
+
+        REQUIRE(result == PrefixScan<cl_float, scan_op::Max>::CalculateCPU(float_elements));
+        REQUIRE(total == 10'006.0f);
+    };
+
+    SECTION("Files")
+    {
+        for (cl_int i = 0; i < 300'000; ++i)
+        {
+            test_elements.push_back(i % 100);
+        }
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+
+        std::ofstream input_file("streaming_input.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+        input_file.write(reinterpret_cast<const char*>(test_elements.data()), test_elements.size() * sizeof(cl_int));
+        input_file.close();
+
+        StreamingPrefixSum streaming_scan(65'536);
+        streaming_scan.CalculateFile("streaming_input.bin", "streaming_output.bin");
+
+        std::vector<cl_int> result(test_elements.size());
+        std::ifstream output_file("streaming_output.bin", std::ios::in | std::ios::binary);
+        output_file.read(reinterpret_cast<char*>(result.data()), result.size() * sizeof(cl_int));
+        REQUIRE(output_file.gcount() == result.size() * sizeof(cl_int));
+        REQUIRE(result == expected_output);
+
+        output_file.close();
+        std::remove("streaming_input.bin");
+        std::remove("streaming_output.bin");
+    };
+
+    SECTION("Streaming vs. single allocation, size == 100000000")
+    {
+        std::cout << "--------------- PrefixScan - streaming, 100000000 elements --------------- " << std::endl;
+
+        for (cl_int i = 0; i < 100'000'000; ++i)
+        {
+            test_elements.push_back(1);
+        }
+        expected_output = PrefixSum::CalculateCPU(test_elements);
+
+        timer.Reset();
+        std::vector<cl_int> test_prefix_sum = PrefixSum::CalculateGPU(test_elements);
+        std::cout << "Duration GPU (single allocation): " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(test_prefix_sum == expected_output);
+
+        for (size_t chunk_size : { 1 << 20, 1 << 22, 1 << 24 })
+        {
+            StreamingPrefixSum streaming_scan(chunk_size);
+
+            timer.Reset();
+            test_prefix_sum.clear();
+            streaming_scan.Calculate(test_elements.begin(), test_elements.end(), std::back_inserter(test_prefix_sum));
+            std::cout << "Duration GPU (streaming, chunk size " << chunk_size << "): " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(test_prefix_sum == expected_output);
+        }
+    };
+};
+
+TEST_CASE("PrefixSum GPU mapped files", "[gpu]")
+{
+    std::vector<cl_int> test_elements;
+    for (cl_int i = 0; i < 1'000'000; ++i)
+    {
+        test_elements.push_back((i % 5) - 2);
+    }
+    std::vector<cl_int> expected_output = PrefixSum::CalculateCPU(test_elements);
+
+    std::ofstream input_file("mapped_input.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+    input_file.write(reinterpret_cast<const char*>(test_elements.data()), test_elements.size() * sizeof(cl_int));
+    input_file.close();
+
+    SECTION("Zero copy scan of a mapped file")
+    {
+        MappedArray<cl_int> mapped_input;
+        MappedArray<cl_int> mapped_result;
+        REQUIRE(mapped_input.Open("mapped_input.bin"));
+        REQUIRE(mapped_input.size() == test_elements.size());
+        REQUIRE(mapped_result.Create("mapped_result.bin", mapped_input.size()));
+
+        // Mappings are page aligned
+        REQUIRE(reinterpret_cast<uintptr_t>(mapped_input.data()) % mpp::constants::ZERO_COPY_ALIGNMENT == 0);
+
+        PrefixSum prefix_sum;
+        prefix_sum.Calculate(mapped_input.data(), mapped_result.data(), mapped_input.size());
+        REQUIRE(std::equal(mapped_result.begin(), mapped_result.end(), expected_output.begin()));
+    };
+
+    SECTION("Streamed scan of a mapped file")
+    {
+        MappedArray<cl_int> mapped_input;
+        MappedArray<cl_int> mapped_result;
+        REQUIRE(mapped_input.Open("mapped_input.bin"));
+        REQUIRE(mapped_result.Create("mapped_result.bin", mapped_input.size()));
+
+        StreamingPrefixSum streaming_scan(100'000);
+        streaming_scan.Calculate(mapped_input.begin(), mapped_input.end(), mapped_result.begin());
+        REQUIRE(std::equal(mapped_result.begin(), mapped_result.end(), expected_output.begin()));
+    };
+
+    SECTION("Missing file")
+    {
+        MappedArray<cl_int> mapped_input;
+        REQUIRE(mapped_input.Open("missing_input.bin") == false);
+        REQUIRE(mapped_input.IsOpen() == false);
+    };
+
+    std::remove("mapped_input.bin");
+    std::remove("mapped_result.bin");
+};
+
+TEST_CASE("StreamCompaction GPU", "[gpu]")
+{
+    std::vector<cl_int> test_elements;
+
+    Timer timer;
+
+    SECTION("Predicates and sizes")
+    {
+        StreamCompaction<cl_int> stream_compaction;
+
+        for (size_t size : { 1, 255, 256, 257, 100'000 })
+        {
+            test_elements.clear();
+            for (cl_int i = 0; i < size; ++i)
+            {
+                test_elements.push_back((i * 7) % 23 - 11);
+            }
+
+            REQUIRE(stream_compaction.Compact(test_elements, "x > 0") == StreamCompaction<cl_int>::CompactCPU(test_elements, [](cl_int x) { return x > 0; }));
+            REQUIRE(stream_compaction.Compact(test_elements, "(x & 1) == 0") == StreamCompaction<cl_int>::CompactCPU(test_elements, [](cl_int x) { return (x & 1) == 0; }));
+            REQUIRE(stream_compaction.Compact(test_elements, "false").empty());
+            REQUIRE(stream_compaction.Compact(test_elements, "true") == test_elements);
+        }
+    };
+
+    SECTION("Floating point elements")
+    {
+        std::vector<cl_float> float_elements;
+        for (size_t i = 0; i < 50'000; ++i)
+        {
+            float_elements.push_back(static_cast<cl_float>(i % 1'000) * 0.5f);
+        }
+
+        StreamCompaction<cl_float> stream_compaction;
+        REQUIRE(stream_compaction.Compact(float_elements, "x >= 100.0f && x < 200.0f") ==
+            StreamCompaction<cl_float>::CompactCPU(float_elements, [](cl_float x) { return x >= 100.0f && x < 200.0f; }));
+    };
+
+    SECTION("Filter time, device vs. host scatter, size == 10000000")
+    {
+        std::cout << "--------------- StreamCompaction - 10000000 elements --------------- " << std::endl;
+
+        for (cl_int i = 0; i < 10'000'000; ++i)
+        {
+            test_elements.push_back(i % 100);
+        }
+        std::vector<cl_int> expected_output = StreamCompaction<cl_int>::CompactCPU(test_elements, [](cl_int x) { return x < 10; });
+
+        // Previous approach: flags on the host, positions from the device scan, scatter on the host
+        timer.Reset();
+        std::vector<cl_int> flags(test_elements.size());
+        for (size_t i = 0; i < test_elements.size(); ++i)
+        {
+            flags[i] = test_elements[i] < 10 ? 1 : 0;
+        }
+        std::vector<cl_int> positions = PrefixSum::CalculateGPU(flags);
+        std::vector<cl_int> host_result(positions.back() + flags.back());
+        for (size_t i = 0; i < test_elements.size(); ++i)
+        {
+            if (flags[i])
+            {
+                host_result[positions[i]] = test_elements[i];
+            }
+        }
+        std::cout << "Duration GPU scan + host scatter: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(host_result == expected_output);
+
+        StreamCompaction<cl_int> stream_compaction(test_elements.size());
+        stream_compaction.Compact(test_elements, "x < 10");     // Warm up, builds the kernels
+
+        timer.Reset();
+        std::vector<cl_int> result = stream_compaction.Compact(test_elements, "x < 10");
+        std::cout << "Duration GPU compaction: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(result == expected_output);
+    };
+};
+
+TEST_CASE("RadixSort GPU", "[gpu]")
+{
+    std::vector<cl_uint> test_keys;
+    std::vector<cl_uint> test_values;
+
+    Timer timer;
+    std::mt19937 generator(42);
+
+    SECTION("Keys, digit widths and sizes")
+    {
+        for (uint32_t radix_bits : { 4, 8 })
+        {
+            RadixSort radix_sort;
+            radix_sort.radix_bits = radix_bits;
+
+            for (size_t size : { 1, 2, 1023, 1024, 1025, 100'000 })
+            {
+                test_keys.clear();
+                for (size_t i = 0; i < size; ++i)
+                {
+                    test_keys.push_back(generator());
+                }
+                std::vector<cl_uint> expected_output = test_keys;
+                std::sort(expected_output.begin(), expected_output.end());
+
+                radix_sort.Sort(test_keys);
+                REQUIRE(test_keys == expected_output);
+            }
+        }
+    };
+
+    SECTION("Key value pairs are sorted stable")
+    {
+        for (uint32_t radix_bits : { 4, 8 })
+        {
+            RadixSort radix_sort;
+            radix_sort.radix_bits = radix_bits;
+
+            // Few distinct keys, the values record the input order
+            test_keys.clear();
+            test_values.clear();
+            for (cl_uint i = 0; i < 50'000; ++i)
+            {
+                test_keys.push_back(generator() % 100 * 0x01010101u);
+                test_values.push_back(i);
+            }
+            std::vector<cl_uint> expected_keys = test_keys;
+            std::vector<cl_uint> expected_values = test_values;
+            RadixSort::SortCPU(expected_keys, expected_values);
+
+            radix_sort.Sort(test_keys, test_values);
+            REQUIRE(test_keys == expected_keys);
+            REQUIRE(test_values == expected_values);
+        }
+    };
+
+    SECTION("Sort time, std::sort vs. radix sort, size == 10000000")
+    {
+        std::cout << "--------------- RadixSort - 10000000 keys --------------- " << std::endl;
+
+        for (size_t i = 0; i < 10'000'000; ++i)
+        {
+            test_keys.push_back(generator());
+        }
+
+        std::vector<cl_uint> expected_output = test_keys;
+        timer.Reset();
+        std::sort(expected_output.begin(), expected_output.end());
+        std::cout << "Duration std::sort: " << timer.GetElapsed() << " seconds" << std::endl;
+
+        for (uint32_t radix_bits : { 4, 8 })
+        {
+            RadixSort radix_sort(test_keys.size());
+            radix_sort.radix_bits = radix_bits;
+            std::vector<cl_uint> keys = test_keys;
+            radix_sort.Sort(keys);     // Warm up, builds the kernels
+
+            keys = test_keys;
+            timer.Reset();
+            radix_sort.Sort(keys);
+            std::cout << "Duration GPU radix sort, " << radix_bits << " bit digits: " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(keys == expected_output);
+        }
+    };
+};
+
+TEST_CASE("Histogram GPU", "[gpu]")
+{
+    OpenCLManager* mgr = OpenCLManager::GetInstance();
+    mgr->LoadKernel(mpp::filenames::KERNELS_HISTOGRAM, { mpp::kernels::HISTOGRAM });
+
+    std::vector<cl_uint> test_keys;
+
+    Timer timer;
+    std::mt19937 generator(42);
+
+    SECTION("Local bins and range bucketing")
+    {
+        Histogram histogram;
+
+        for (size_t size : { 0, 1, 255, 256, 257, 100'000 })
+        {
+            test_keys.clear();
+            for (size_t i = 0; i < size; ++i)
+            {
+                test_keys.push_back(generator());
+            }
+
+            // A single bin, local bins only, several ranges and a last range that is only partially used
+            for (uint32_t num_bins : { 1, 16, 4096, 10'000 })
+            {
+                REQUIRE(histogram.Calculate(test_keys, num_bins) == Histogram::CalculateCPU(test_keys, num_bins));
+            }
+        }
+    };
+
+    SECTION("Shifted keys")
+    {
+        for (cl_uint i = 0; i < 50'000; ++i)
+        {
+            test_keys.push_back(generator());
+        }
+
+        Histogram histogram;
+        histogram.shift = 24;
+        REQUIRE(histogram.Calculate(test_keys, 256) == Histogram::CalculateCPU(test_keys, 256, 24));
+    };
+
+    SECTION("Partition offsets")
+    {
+        for (cl_uint i = 0; i < 100'000; ++i)
+        {
+            test_keys.push_back(generator() % 1'000);
+        }
+
+        Histogram histogram;
+        std::vector<cl_uint> offsets = histogram.CalculateOffsets(test_keys, 1'000);
+        REQUIRE(offsets == PrefixScan<cl_uint>::CalculateCPU(Histogram::CalculateCPU(test_keys, 1'000)));
+    };
+
+    SECTION("Histogram time, host vs. device, size == 10000000")
+    {
+        std::cout << "--------------- Histogram - 10000000 keys --------------- " << std::endl;
+
+        for (size_t i = 0; i < 10'000'000; ++i)
+        {
+            test_keys.push_back(generator());
+        }
+
+        for (uint32_t num_bins : { 256, 65'536 })
+        {
+            timer.Reset();
+            std::vector<cl_uint> expected_output = Histogram::CalculateCPU(test_keys, num_bins);
+            std::cout << "Duration CPU, " << num_bins << " bins: " << timer.GetElapsed() << " seconds" << std::endl;
+
+            Histogram histogram(test_keys.size(), num_bins);
+            histogram.Calculate(test_keys, num_bins);     // Warm up, builds the kernel
+
+            timer.Reset();
+            std::vector<cl_uint> result = histogram.Calculate(test_keys, num_bins);
+            std::cout << "Duration GPU, " << num_bins << " bins: " << timer.GetElapsed() << " seconds" << std::endl;
+            REQUIRE(result == expected_output);
+        }
+    };
+};
+
+TEST_CASE("Reduction GPU", "[gpu]")
+{
+    std::vector<cl_int> test_elements;
+
+    Timer timer;
+    std::mt19937 generator(42);
+
+    SECTION("Sum, min and max of different sizes")
+    {
+        Reduction<cl_int, scan_op::Sum> sum;
+        Reduction<cl_int, scan_op::Min> min;
+        Reduction<cl_int, scan_op::Max> max;
+
+        // Below a work group, a single work group, several work groups and more than the maximum number of work groups
+        for (size_t size : { 0, 1, 255, 4'096, 4'097, 2'000'000 })
+        {
+            test_elements.clear();
+            for (size_t i = 0; i < size; ++i)
+            {
+                test_elements.push_back(static_cast<cl_int>(generator() % 2'001) - 1'000);
+            }
+
+            REQUIRE(sum.Calculate(test_elements) == Reduction<cl_int, scan_op::Sum>::CalculateCPU(test_elements));
+            REQUIRE(min.Calculate(test_elements) == Reduction<cl_int, scan_op::Min>::CalculateCPU(test_elements));
+            REQUIRE(max.Calculate(test_elements) == Reduction<cl_int, scan_op::Max>::CalculateCPU(test_elements));
+        }
+    };
+
+    SECTION("Element types")
+    {
+        std::vector<cl_double> double_elements;
+        std::vector<cl_ulong> ulong_elements;
+        for (size_t i = 0; i < 100'000; ++i)
+        {
+            double_elements.push_back(static_cast<cl_double>(i % 1'000) * 0.25);
+            ulong_elements.push_back(static_cast<cl_ulong>(i) << 20);
+        }
+
+        // The sums are exact, all partial sums are representable
+        Reduction<cl_double, scan_op::Sum> double_sum;
+        REQUIRE(double_sum.Calculate(double_elements) == Reduction<cl_double, scan_op::Sum>::CalculateCPU(double_elements));
+        Reduction<cl_ulong, scan_op::Sum> ulong_sum;
+        REQUIRE(ulong_sum.Calculate(ulong_elements) == Reduction<cl_ulong, scan_op::Sum>::CalculateCPU(ulong_elements));
+        Reduction<cl_ulong, scan_op::Max> ulong_max;
+        REQUIRE(ulong_max.Calculate(ulong_elements) == ulong_elements.back());
+    };
+
+    SECTION("Argmin and argmax return the first occurrence")
+    {
+        Reduction<cl_int, scan_op::Min> min;
+        Reduction<cl_int, scan_op::Max> max;
+
+        for (size_t size : { 1, 255, 4'097, 2'000'000 })
+        {
+            // Few distinct values, so the extremes occur many times
+            test_elements.clear();
+            for (size_t i = 0; i < size; ++i)
+            {
+                test_elements.push_back(static_cast<cl_int>(generator() % 50));
+            }
+
+            REQUIRE(min.CalculateIndex(test_elements) == Reduction<cl_int, scan_op::Min>::CalculateIndexCPU(test_elements));
+            REQUIRE(max.CalculateIndex(test_elements) == Reduction<cl_int, scan_op::Max>::CalculateIndexCPU(test_elements));
+        }
+
+        std::vector<cl_float> float_elements = { 3.0f, -1.0f, 7.5f, -1.0f, 7.5f };
+        Reduction<cl_float, scan_op::Min> float_min;
+        REQUIRE(float_min.CalculateIndex(float_elements) == 1);
+        Reduction<cl_float, scan_op::Max> float_max;
+        REQUIRE(float_max.CalculateIndex(float_elements) == 2);
+    };
+
+    SECTION("Total time, scan + read back vs. reduction, size == 10000000")
+    {
+        std::cout << "--------------- Reduction - 10000000 elements --------------- " << std::endl;
+
+        for (size_t i = 0; i < 10'000'000; ++i)
+        {
+            test_elements.push_back(static_cast<cl_int>(i % 100));
+        }
+        cl_int expected_output = Reduction<cl_int, scan_op::Sum>::CalculateCPU(test_elements);
+
+        // Previous approach: scan everything, read it back and take the last element
+        PrefixSum prefix_sum(test_elements.size());
+        prefix_sum.mode = PrefixSum::ScanMode::Inclusive;
+        prefix_sum.Calculate(test_elements);   // Warm up, builds the kernels
+        timer.Reset();
+        cl_int scan_total = prefix_sum.Calculate(test_elements).back();
+        std::cout << "Duration GPU scan: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(scan_total == expected_output);
+
+        SumReduction sum(test_elements.size());
+        sum.Calculate(test_elements);   // Warm up, builds the kernel
+        timer.Reset();
+        cl_int total = sum.Calculate(test_elements);
+        std::cout << "Duration GPU reduction: " << timer.GetElapsed() << " seconds" << std::endl;
+        REQUIRE(total == expected_output);
+    };
+};
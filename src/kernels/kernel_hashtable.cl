@@ -14,6 +14,7 @@ typedef unsigned long		uint64_t;
 #define STATUS_ERROR 1
 #define HASH_P 334214459 
 #define KEY_EMPTY 0xFFFFFFFF
+#define ENTRY_EMPTY 0xFFFFFFFFFFFFFFFFUL
 
 #define PARAM_IDX_HASH_FUNC_A_0		0
 #define PARAM_IDX_HASH_FUNC_B_0		1
@@ -25,45 +26,183 @@ typedef unsigned long		uint64_t;
 #define PARAM_IDX_HASH_FUNC_B_3		7
 #define PARAM_IDX_MAX_ITERATIONS	8
 #define PARAM_IDX_TABLESIZE			9
+#define PARAM_IDX_HASH_FUNC_A_STASH	10
+#define PARAM_IDX_HASH_FUNC_B_STASH	11
+#define PARAM_IDX_STASH_SIZE		12
+#define PARAM_IDX_BUCKET_SIZE		13
+#define PARAM_IDX_PARTITIONED		14
+
+// Two-level layout: every partition holds at most PARTITION_MAX_KEYS keys in three sub-tables of PARTITION_SUBTABLE_SIZE slots
+#define PARTITION_MAX_KEYS			512
+#define PARTITION_SUBTABLE_SIZE		192
+#define PARTITION_SLOTS				576
+#define INDEX_EMPTY					0xFFFFFFFF
 
 #define GET_KEY(entry) ( (uint32_t)((entry) >> 32) )
 #define GET_VALUE(entry) ((uint32_t)((entry)))
 #define MAKE_ENTRY(key,value) ( (((uint64_t)key) << 32) + (value) )
-#define HASH_FUNCTION(key, a, b, table_size) ( (a * key + b) % HASH_P % table_size  )
+#define HASH_FUNCTION(key, a, b, table_size) ( ((a) * (key) + (b)) % HASH_P % (table_size) )
+
+// Two-level layout: the partition of a key uses the fourth hash function, the sub-table i of a partition the hash function i
+#define PARTITION_HASH(key, params) HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_3], params[PARAM_IDX_HASH_FUNC_B_3], params[PARAM_IDX_TABLESIZE] / PARTITION_SLOTS)
+#define SUBTABLE_LOCATION(key, i, params) ( (i) * PARTITION_SUBTABLE_SIZE + \
+	HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_0 + 2 * (i)], params[PARAM_IDX_HASH_FUNC_B_0 + 2 * (i)], PARTITION_SUBTABLE_SIZE) )
 
-__kernel void Insert(__global uint32_t* keys, __global uint32_t* values, __global uint64_t* table, __constant uint32_t* params, __global uint32_t* status)
+// The stash is a small array of entries behind the table for the entries no eviction chain could place.
+// The slot of the stash hash function and the following slots are probed. Returns an empty entry on success.
+inline uint64_t StashEntry(uint64_t entry, __global uint64_t* table, __constant uint32_t* params)
 {
-	int32_t global_id = get_global_id(0);
-	int32_t local_id = get_local_id(0);
-	int32_t group_id = get_group_id(0);
+	uint32_t stash_size = params[PARAM_IDX_STASH_SIZE];
+	if (stash_size == 0)
+	{
+		return entry;
+	}
 
-	// Load up the key value pair into a 64 bit int.
-	uint32_t key = keys[global_id];
-	uint32_t value = values[global_id];
-	uint64_t entry = MAKE_ENTRY(key, value);
+	__global uint64_t* stash = table + params[PARAM_IDX_TABLESIZE];
+	uint32_t slot = HASH_FUNCTION(GET_KEY(entry), params[PARAM_IDX_HASH_FUNC_A_STASH], params[PARAM_IDX_HASH_FUNC_B_STASH], stash_size);
 
-	// DEBUG
-	//if (key != GET_KEY(entry))
-	//{
-	//	printf("%s\n", "ASSERT KEY CHECK FAILED\n");
-	//}
-	//if (value != GET_VALUE(entry))
-	//{
-	//	printf("%s\n", "ASSERT KEY CHECK FAILED\n");
-	//}
+	for (uint32_t i = 0; i < stash_size; ++i)
+	{
+		// Stashed entries are never evicted, a slot is only taken if it is empty
+		if (atom_cmpxchg(&stash[slot], ENTRY_EMPTY, entry) == ENTRY_EMPTY)
+		{
+			return ENTRY_EMPTY;
+		}
 
-	if (key == KEY_EMPTY)
+		slot = (slot + 1 == stash_size) ? 0 : slot + 1;
+	}
+
+	return entry;
+}
+
+// Looks up the key in the stash. Probing stops at the first empty slot, entries are never removed. Returns an empty entry if the key is not stashed.
+inline uint64_t RetrieveStashEntry(uint32_t key, __global const uint64_t* table, __constant uint32_t* params)
+{
+	uint32_t stash_size = params[PARAM_IDX_STASH_SIZE];
+	if (stash_size == 0)
 	{
-		// KEY_EMPTY is reserved and used for padded values -> We just return
-		keys[global_id] = STATUS_SUCCESS;
-		return;
+		return ENTRY_EMPTY;
+	}
+
+	__global const uint64_t* stash = table + params[PARAM_IDX_TABLESIZE];
+	uint32_t slot = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_STASH], params[PARAM_IDX_HASH_FUNC_B_STASH], stash_size);
+
+	for (uint32_t i = 0; i < stash_size; ++i)
+	{
+		uint64_t entry = stash[slot];
+		if (GET_KEY(entry) == key || entry == ENTRY_EMPTY)
+		{
+			return entry;
+		}
+
+		slot = (slot + 1 == stash_size) ? 0 : slot + 1;
+	}
+
+	return ENTRY_EMPTY;
+}
+
+// Bucketized layout: the table consists of buckets of bucket_size entries (8 entries are one cache line) and every key has two
+// candidate buckets. A free slot of the current bucket is taken first, only a full bucket evicts one of its entries.
+inline uint64_t InsertBucketEntry(uint64_t entry, __global uint64_t* table, __constant uint32_t* params, uint32_t max_iterations)
+{
+	uint32_t bucket_size = params[PARAM_IDX_BUCKET_SIZE];
+	uint32_t num_buckets = params[PARAM_IDX_TABLESIZE] / bucket_size;
+	uint32_t key = GET_KEY(entry);
+
+	// New items are always inserted into their first bucket.
+	uint32_t bucket = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_0], params[PARAM_IDX_HASH_FUNC_B_0], num_buckets);
+
+	for (uint32_t i = 0; i < max_iterations; ++i)
+	{
+		__global uint64_t* slots = table + bucket * bucket_size;
+
+		// Take a free slot of the bucket
+		for (uint32_t slot = 0; slot < bucket_size; ++slot)
+		{
+			if (slots[slot] == ENTRY_EMPTY && atom_cmpxchg(&slots[slot], ENTRY_EMPTY, entry) == ENTRY_EMPTY)
+			{
+				return ENTRY_EMPTY;
+			}
+		}
+
+		// The bucket is full: evict the slot chosen by key and iteration, the evicted item moves to its other bucket.
+		entry = atom_xchg(&slots[(key + i) % bucket_size], entry);
+		key = GET_KEY(entry);
+
+		if (key == KEY_EMPTY)
+		{
+			return entry;
+		}
+
+		uint32_t bucket_0 = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_0], params[PARAM_IDX_HASH_FUNC_B_0], num_buckets);
+		uint32_t bucket_1 = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_1], params[PARAM_IDX_HASH_FUNC_B_1], num_buckets);
+		bucket = (bucket == bucket_0) ? bucket_1 : bucket_0;
+	}
+
+	// The eviction chain was too long
+	return entry;
+}
+
+// Reads at most the two candidate buckets of the key, the stash is checked last
+inline uint64_t RetrieveBucketEntry(uint32_t key, __global const uint64_t* table, __constant uint32_t* params)
+{
+	uint32_t bucket_size = params[PARAM_IDX_BUCKET_SIZE];
+	uint32_t num_buckets = params[PARAM_IDX_TABLESIZE] / bucket_size;
+	uint32_t buckets[2] =
+	{
+		HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_0], params[PARAM_IDX_HASH_FUNC_B_0], num_buckets),
+		HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_1], params[PARAM_IDX_HASH_FUNC_B_1], num_buckets)
+	};
+
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		__global const uint64_t* slots = table + buckets[i] * bucket_size;
+		for (uint32_t slot = 0; slot < bucket_size; ++slot)
+		{
+			uint64_t entry = slots[slot];
+			if (GET_KEY(entry) == key)
+			{
+				return entry;
+			}
+		}
+	}
+
+	return RetrieveStashEntry(key, table, params);
+}
+
+// Reads the three sub-table locations of the key in its partition
+inline uint64_t RetrievePartitionedEntry(uint32_t key, __global const uint64_t* table, __constant uint32_t* params)
+{
+	__global const uint64_t* partition = table + PARTITION_HASH(key, params) * PARTITION_SLOTS;
+
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		uint64_t entry = partition[SUBTABLE_LOCATION(key, i, params)];
+		if (GET_KEY(entry) == key)
+		{
+			return entry;
+		}
 	}
 
+	return ENTRY_EMPTY;
+}
+
+// Inserts the entry with at most max_iterations evictions. Returns an empty entry on success, otherwise the entry that is left over.
+inline uint64_t InsertEntry(uint64_t entry, __global uint64_t* table, __constant uint32_t* params, uint32_t max_iterations)
+{
+	if (params[PARAM_IDX_BUCKET_SIZE] != 0)
+	{
+		entry = InsertBucketEntry(entry, table, params, max_iterations);
+		return (GET_KEY(entry) == KEY_EMPTY) ? entry : StashEntry(entry, table, params);
+	}
+
+	uint32_t key = GET_KEY(entry);
+
 	// New items are always inserted using their first hash function.
 	uint32_t location = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_0], params[PARAM_IDX_HASH_FUNC_B_0], params[PARAM_IDX_TABLESIZE]);
 
 	// Repeat the insertion process while the thread still has an item.
-	for (uint32_t i = 0; i < params[PARAM_IDX_MAX_ITERATIONS]; ++i)
+	for (uint32_t i = 0; i < max_iterations; ++i)
 	{
 		// Insert the new item and check for an eviction.
 		entry = atomic_xchg(&table[location], entry);
@@ -71,8 +210,7 @@ __kernel void Insert(__global uint32_t* keys, __global uint32_t* values, __globa
 
 		if (key == KEY_EMPTY) 
 		{
-			keys[global_id] = STATUS_SUCCESS;
-			return;
+			return entry;
 		}
 	
 		// If an item was evicted, figure out where to reinsert the entry.
@@ -100,9 +238,66 @@ __kernel void Insert(__global uint32_t* keys, __global uint32_t* values, __globa
 		}
 	}
 
-	// The eviction chain was too long; report the failure.
-	keys[global_id] = STATUS_ERROR;
-	status[0] |= STATUS_ERROR;
+	// The eviction chain was too long, the stash takes the entry left over if there is one
+	return StashEntry(entry, table, params);
+}
+
+__kernel void Insert(__global const uint32_t* keys, __global const uint32_t* values, __global uint64_t* table, __constant uint32_t* params, __global uint32_t* status,
+	__global uint64_t* out_failed_entries)
+{
+	int32_t global_id = get_global_id(0);
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+
+	// Load up the key value pair into a 64 bit int.
+	uint32_t key = keys[global_id];
+	uint32_t value = values[global_id];
+	uint64_t entry = MAKE_ENTRY(key, value);
+
+	// DEBUG
+	//if (key != GET_KEY(entry))
+	//{
+	//	printf("%s\n", "ASSERT KEY CHECK FAILED\n");
+	//}
+	//if (value != GET_VALUE(entry))
+	//{
+	//	printf("%s\n", "ASSERT KEY CHECK FAILED\n");
+	//}
+
+	// KEY_EMPTY is reserved and used for padded values -> They are not inserted
+	if (key != KEY_EMPTY)
+	{
+		entry = InsertEntry(entry, table, params, params[PARAM_IDX_MAX_ITERATIONS]);
+	}
+
+	// With the recovery pass every work item writes the entry it is left with, an empty entry on success. Keys and values are left
+	// untouched, so the host can either re-insert the compacted failed entries or rebuild the table from the same buffers.
+	if (out_failed_entries != 0)
+	{
+		out_failed_entries[global_id] = entry;
+	}
+	if (GET_KEY(entry) != KEY_EMPTY)
+	{
+		// The eviction chain was too long; report the failure.
+		status[0] |= STATUS_ERROR;
+	}
+}
+
+// Second pass for the entries left over by Insert, compacted by the host. The eviction chains may be longer than in the first pass.
+__kernel void Reinsert(__global const uint64_t* entries, __global uint64_t* table, __constant uint32_t* params, __global uint32_t* status,
+	__private uint32_t num_entries, __private uint32_t max_iterations)
+{
+	uint32_t global_id = get_global_id(0);
+	if (global_id >= num_entries)
+	{
+		return;
+	}
+
+	uint64_t entry = InsertEntry(entries[global_id], table, params, max_iterations);
+	if (GET_KEY(entry) != KEY_EMPTY)
+	{
+		status[0] |= STATUS_ERROR;
+	}
 }
 
 __kernel void Retrieve(__global int32_t* keys, __global int32_t* out_values, __global int64_t* table, __constant uint32_t* params)
@@ -117,6 +312,18 @@ __kernel void Retrieve(__global int32_t* keys, __global int32_t* out_values, __g
 		return;
 	}
 
+	if (params[PARAM_IDX_BUCKET_SIZE] != 0)
+	{
+		out_values[global_id] = GET_VALUE(RetrieveBucketEntry(key, (__global const uint64_t*)table, params));
+		return;
+	}
+
+	if (params[PARAM_IDX_PARTITIONED] != 0)
+	{
+		out_values[global_id] = GET_VALUE(RetrievePartitionedEntry(key, (__global const uint64_t*)table, params));
+		return;
+	}
+
 	// Cycle through all potential locations in hash table and check if requested key exists
 	uint32_t location_0 = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_0], params[PARAM_IDX_HASH_FUNC_B_0], params[PARAM_IDX_TABLESIZE]);
 	uint32_t location_1 = HASH_FUNCTION(key, params[PARAM_IDX_HASH_FUNC_A_1], params[PARAM_IDX_HASH_FUNC_B_1], params[PARAM_IDX_TABLESIZE]);
@@ -133,8 +340,8 @@ __kernel void Retrieve(__global int32_t* keys, __global int32_t* out_values, __g
 			{
 				if (GET_KEY(entry = table[location_3]) != key)
 				{
-					// Did not find the requested key
-					out_values[global_id] = KEY_EMPTY;
+					// Not in the table, the stash is checked last. Its entry is empty if the requested key does not exist.
+					entry = RetrieveStashEntry(key, (__global const uint64_t*)table, params);
 				}
 			}
 		}
@@ -142,3 +349,106 @@ __kernel void Retrieve(__global int32_t* keys, __global int32_t* out_values, __g
 
 	out_values[global_id] = GET_VALUE(entry);
 }
+
+// Two-level build, step 1: the partition of every key. The keys per partition are counted by the histogram and scanned to the partition offsets.
+__kernel void Partition(__global const uint32_t* keys, __global uint32_t* out_partitions, __constant uint32_t* params, __private uint32_t num_keys)
+{
+	uint32_t global_id = get_global_id(0);
+	if (global_id < num_keys)
+	{
+		out_partitions[global_id] = PARTITION_HASH(keys[global_id], params);
+	}
+}
+
+// Two-level build, step 2: groups the entries by partition. The order within a partition does not matter, the cursors have to be zeroed before.
+__kernel void PartitionScatter(__global const uint32_t* keys, __global const uint32_t* values, __global const uint32_t* partitions, __global const uint32_t* partition_offsets,
+	__global uint32_t* partition_cursors, __global uint64_t* out_entries, __private uint32_t num_keys)
+{
+	uint32_t global_id = get_global_id(0);
+	if (global_id < num_keys)
+	{
+		uint32_t partition = partitions[global_id];
+		uint32_t position = partition_offsets[partition] + atomic_inc(&partition_cursors[partition]);
+		out_entries[position] = MAKE_ENTRY(keys[global_id], values[global_id]);
+	}
+}
+
+// Two-level build, step 3: one work group per partition builds its cuckoo sub-tables in local memory. The sub-tables hold indices
+// of the partition's entries, so the evictions are 32 bit local atomics. The finished partition is written to the table once.
+__kernel void BuildPartitions(__global const uint64_t* entries, __global const uint32_t* partition_counts, __global const uint32_t* partition_offsets,
+	__global uint64_t* table, __constant uint32_t* params, __global uint32_t* status, __private uint32_t max_iterations)
+{
+	__local uint64_t local_entries[PARTITION_MAX_KEYS];
+	__local uint32_t local_table[PARTITION_SLOTS];
+	__local uint32_t local_status;
+
+	uint32_t partition = get_group_id(0);
+	uint32_t local_id = get_local_id(0);
+	uint32_t local_size = get_local_size(0);
+	uint32_t num_entries = partition_counts[partition];
+
+	if (num_entries > PARTITION_MAX_KEYS)
+	{
+		// The partition does not fit into local memory, the table is rebuilt with another partition hash
+		if (local_id == 0)
+		{
+			status[0] |= STATUS_ERROR;
+		}
+		return;
+	}
+
+	// 1. Load the entries of the partition and clear the sub-tables
+	__global const uint64_t* partition_entries = entries + partition_offsets[partition];
+	for (uint32_t i = local_id; i < num_entries; i += local_size)
+	{
+		local_entries[i] = partition_entries[i];
+	}
+	for (uint32_t slot = local_id; slot < PARTITION_SLOTS; slot += local_size)
+	{
+		local_table[slot] = INDEX_EMPTY;
+	}
+	if (local_id == 0)
+	{
+		local_status = STATUS_SUCCESS;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// 2. Cuckoo insertion, an evicted entry moves on to the next sub-table (round robin fashion)
+	for (uint32_t i = local_id; i < num_entries; i += local_size)
+	{
+		uint32_t index = i;
+		uint32_t location = SUBTABLE_LOCATION(GET_KEY(local_entries[index]), 0, params);
+
+		for (uint32_t iteration = 0; iteration < max_iterations; ++iteration)
+		{
+			index = atomic_xchg(&local_table[location], index);
+			if (index == INDEX_EMPTY)
+			{
+				break;
+			}
+
+			uint32_t subtable = location / PARTITION_SUBTABLE_SIZE + 1;
+			location = SUBTABLE_LOCATION(GET_KEY(local_entries[index]), (subtable == 3) ? 0 : subtable, params);
+		}
+
+		if (index != INDEX_EMPTY)
+		{
+			// The eviction chain was too long
+			local_status = STATUS_ERROR;
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// 3. Write the sub-tables of the partition
+	__global uint64_t* partition_table = table + partition * PARTITION_SLOTS;
+	for (uint32_t slot = local_id; slot < PARTITION_SLOTS; slot += local_size)
+	{
+		uint32_t index = local_table[slot];
+		partition_table[slot] = (index == INDEX_EMPTY) ? ENTRY_EMPTY : local_entries[index];
+	}
+
+	if (local_id == 0 && local_status != STATUS_SUCCESS)
+	{
+		status[0] |= STATUS_ERROR;
+	}
+}
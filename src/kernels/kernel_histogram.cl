@@ -0,0 +1,50 @@
+// Typedefs for better comparison of host and device types
+typedef int					int32_t;
+typedef unsigned int		uint32_t;
+
+// Number of bins a work group counts in local memory, can be overridden with a build option, e.g. "-DLOCAL_BINS=2048"
+#ifndef LOCAL_BINS
+#define LOCAL_BINS 4096
+#endif
+
+// Histogram of (key >> shift) % num_bins with privatized bins: every work group counts its keys in local memory
+// and adds its bins to the global histogram once, so the global atomics are reduced to one per bin and work group.
+// Range bucketing for more bins than fit into local memory: dimension 1 of the NDRange selects the range of LOCAL_BINS bins
+// a work group counts, keys of other ranges are skipped. The global histogram has to be zeroed before.
+__kernel void Histogram(__global uint32_t* buffer_keys, __global uint32_t* buffer_histogram, __private uint32_t num_elements, __private uint32_t num_bins, __private uint32_t shift)
+{
+	__local uint32_t local_bins[LOCAL_BINS];
+
+	int32_t local_id = get_local_id(0);
+	int32_t local_size = get_local_size(0);
+	uint32_t bin_offset = get_group_id(1) * LOCAL_BINS;
+	uint32_t num_local_bins = min((uint32_t)LOCAL_BINS, num_bins - bin_offset);
+
+	// 1. Clear the local bins
+	for (uint32_t bin = local_id; bin < num_local_bins; bin += local_size)
+	{
+		local_bins[bin] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// 2. Count the keys of this range, grid stride over the input. Bins below the range wrap around and are skipped as well.
+	for (uint32_t i = get_global_id(0); i < num_elements; i += get_global_size(0))
+	{
+		uint32_t bin = (buffer_keys[i] >> shift) % num_bins - bin_offset;
+		if (bin < num_local_bins)
+		{
+			atomic_inc(&local_bins[bin]);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// 3. Merge into the global histogram
+	for (uint32_t bin = local_id; bin < num_local_bins; bin += local_size)
+	{
+		uint32_t count = local_bins[bin];
+		if (count > 0)
+		{
+			atomic_add(&buffer_histogram[bin_offset + bin], count);
+		}
+	}
+}
@@ -1,5 +1,28 @@
+// Work group size and elements per work item can be overridden with build options, e.g. "-DMAX_THREADS_PER_CU=128 -DLOG2_MAX_THREADS_PER_CU=7 -DELEMENTS_PER_ITEM=4"
+#ifndef MAX_THREADS_PER_CU
 #define MAX_THREADS_PER_CU 256
 #define LOG2_MAX_THREADS_PER_CU 8
+#endif
+
+#ifndef ELEMENTS_PER_ITEM
+#define ELEMENTS_PER_ITEM 1
+#endif
+
+// Number of elements scanned by one work group
+#define TILE_SIZE (MAX_THREADS_PER_CU * ELEMENTS_PER_ITEM)
+
+// Padding of the local scan array to avoid bank conflicts in the up/down sweep (GPU Gems 3, chapter 39.2.3). Enabled with "-DCONFLICT_FREE_OFFSETS".
+#ifdef CONFLICT_FREE_OFFSETS
+#ifndef LOG_NUM_BANKS
+#define LOG_NUM_BANKS 5
+#endif
+#define CONFLICT_FREE_OFFSET(n) ((n) >> LOG_NUM_BANKS)
+#else
+#define CONFLICT_FREE_OFFSET(n) 0
+#endif
+
+#define LOCAL_INDEX(n) ((n) + CONFLICT_FREE_OFFSET(n))
+#define LOCAL_ARRAY_SIZE (MAX_THREADS_PER_CU + CONFLICT_FREE_OFFSET(MAX_THREADS_PER_CU))
 
 // Typedefs for better comparison of host and device types
 typedef char				int8_t;
@@ -11,18 +34,125 @@ typedef unsigned int		uint32_t;
 typedef long				int64_t;
 typedef unsigned long		uint64_t;
 
-__kernel void PrefixSum256(__global int32_t* buffer_a, __global int32_t* buffer_b, __global int32_t* buffer_c)
+// Sub group scans are enabled with "-DUSE_SUBGROUPS" if OpenCLManager::subgroups_supported is set
+#ifdef USE_SUBGROUPS
+#if defined(cl_khr_subgroups)
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#elif defined(cl_intel_subgroups)
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+#endif
+#endif
+
+// Element type and scan operator, e.g. "-DT=float -DT_LOWEST=-INFINITY -DT_HIGHEST=INFINITY -DOP=OP_MAX". Defaults to an int sum.
+#define OP_SUM 0
+#define OP_MAX 1
+#define OP_MIN 2
+
+#ifndef T
+#define T int
+#define T_LOWEST INT_MIN
+#define T_HIGHEST INT_MAX
+#endif
+
+#ifndef OP
+#define OP OP_SUM
+#endif
+
+#if defined(cl_khr_fp64)
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#if OP == OP_MAX
+#define APPLY(a, b) max((T)(a), (T)(b))
+#define IDENTITY T_LOWEST
+#define SUB_GROUP_SCAN_EXCLUSIVE(x) sub_group_scan_exclusive_max(x)
+#define SUB_GROUP_REDUCE(x) sub_group_reduce_max(x)
+#elif OP == OP_MIN
+#define APPLY(a, b) min((T)(a), (T)(b))
+#define IDENTITY T_HIGHEST
+#define SUB_GROUP_SCAN_EXCLUSIVE(x) sub_group_scan_exclusive_min(x)
+#define SUB_GROUP_REDUCE(x) sub_group_reduce_min(x)
+#else
+#define APPLY(a, b) ((a) + (b))
+#define IDENTITY ((T)0)
+#define SUB_GROUP_SCAN_EXCLUSIVE(x) sub_group_scan_exclusive_add(x)
+#define SUB_GROUP_REDUCE(x) sub_group_reduce_add(x)
+#endif
+
+// Scan mode of the elements written to the result buffer. Only the top level of the recursive scan is built with these options, the
+// sums of the sub arrays are always scanned exclusively and forward.
+// SCAN_INCLUSIVE: element i of the result includes element i of the input
+// SCAN_REVERSE: scans from the last to the first element
+#ifdef SCAN_REVERSE
+#define ELEMENT_INDEX(i) (num_elements - 1 - (i))
+#else
+#define ELEMENT_INDEX(i) (i)
+#endif
+
+// Transforms of the elements read from buffer A and of the results written to buffer B, e.g. a predicate turned into 0/1 before the scan.
+// Only the top level kernels get them, PrefixScan prepends their definitions to the source (load_transform, store_transform).
+#ifndef LOAD_TRANSFORM
+#define LOAD_TRANSFORM(x) (x)
+#endif
+
+#ifndef STORE_TRANSFORM
+#define STORE_TRANSFORM(x) (x)
+#endif
+
+#define TILE_STATUS_INVALID 0
+#define TILE_STATUS_AGGREGATE 1
+#define TILE_STATUS_PREFIX 2
+
+#ifdef USE_SUBGROUPS
+// Exclusive scan of MAX_THREADS_PER_CU elements in local memory built from sub group scans. Element i is stored at LOCAL_INDEX(i).
+// Every sub group scans its elements in registers, the sub group sums are exchanged once through local memory.
+void ScanLocal(__local T* local_array, int32_t local_id)
 {
-	int32_t global_id = get_global_id(0);
-	int32_t local_id = get_local_id(0);
-	int32_t group_id = get_group_id(0);
+	uint32_t sub_group_id = get_sub_group_id();
+	uint32_t sub_group_local_id = get_sub_group_local_id();
+	uint32_t sub_group_size = get_max_sub_group_size();
+	uint32_t num_sub_groups = get_num_sub_groups();
 
-	__local int32_t local_array[MAX_THREADS_PER_CU];
+	T element = local_array[LOCAL_INDEX(local_id)];
+	T prefix = SUB_GROUP_SCAN_EXCLUSIVE(element);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// The last work item of every sub group publishes the sum of its sub group
+	if (sub_group_local_id == get_sub_group_size() - 1)
+	{
+		local_array[LOCAL_INDEX(sub_group_id)] = APPLY(prefix, element);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-	// copy to local memory
-	local_array[local_id] = buffer_a[global_id];
+	// The first sub group scans the sub group sums, in chunks of its size if there are more sub groups than work items in a sub group
+	if (sub_group_id == 0)
+	{
+		T carry = IDENTITY;
+		for (uint32_t chunk = 0; chunk < num_sub_groups; chunk += sub_group_size)
+		{
+			uint32_t index = chunk + sub_group_local_id;
+			T sum = index < num_sub_groups ? local_array[LOCAL_INDEX(index)] : IDENTITY;
+			T sum_prefix = SUB_GROUP_SCAN_EXCLUSIVE(sum);
+			if (index < num_sub_groups)
+			{
+				local_array[LOCAL_INDEX(index)] = APPLY(carry, sum_prefix);
+			}
+			carry = APPLY(carry, SUB_GROUP_REDUCE(sum));
+		}
+	}
 	barrier(CLK_LOCAL_MEM_FENCE);
 
+	prefix = APPLY(local_array[LOCAL_INDEX(sub_group_id)], prefix);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	local_array[LOCAL_INDEX(local_id)] = prefix;
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+#else
+// Blelloch scan of MAX_THREADS_PER_CU elements in local memory. Turns local_array into its exclusive prefix sum.
+// Element i is stored at LOCAL_INDEX(i).
+void ScanLocal(__local T* local_array, int32_t local_id)
+{
 	int32_t tree_depth = LOG2_MAX_THREADS_PER_CU; // Depth of a balanced tree with k leaves is log(k)
 
 	// Up-Sweep / Reduce Phase
@@ -34,7 +164,9 @@ __kernel void PrefixSum256(__global int32_t* buffer_a, __global int32_t* buffer_
 		{
 			size_t index_1 = local_id * (offset << 1) + offset - 1;
 			size_t index_2 = index_1 + offset;
-			local_array[index_2] = local_array[index_1] + local_array[index_2];
+			index_1 = LOCAL_INDEX(index_1);
+			index_2 = LOCAL_INDEX(index_2);
+			local_array[index_2] = APPLY(local_array[index_1], local_array[index_2]);
 		}
 
 		offset <<= 1;
@@ -46,7 +178,7 @@ __kernel void PrefixSum256(__global int32_t* buffer_a, __global int32_t* buffer_
 	// Down-Sweep Phase
 	if (local_id == MAX_THREADS_PER_CU -1)
 	{
-		local_array[MAX_THREADS_PER_CU -1] = 0;
+		local_array[LOCAL_INDEX(MAX_THREADS_PER_CU -1)] = IDENTITY;
 	}
 	barrier(CLK_LOCAL_MEM_FENCE);
 
@@ -58,9 +190,11 @@ __kernel void PrefixSum256(__global int32_t* buffer_a, __global int32_t* buffer_
 		{
 			size_t index_1 = local_id*(offset << 1) + offset - 1;
 			size_t index_2 = index_1 + offset;
-			int32_t tmp = local_array[index_1];
+			index_1 = LOCAL_INDEX(index_1);
+			index_2 = LOCAL_INDEX(index_2);
+			T tmp = local_array[index_1];
 			local_array[index_1] = local_array[index_2];
-			local_array[index_2] = tmp + local_array[index_2];
+			local_array[index_2] = APPLY(local_array[index_2], tmp);
 		}
 
 		num_working_items <<= 1;
@@ -68,26 +202,423 @@ __kernel void PrefixSum256(__global int32_t* buffer_a, __global int32_t* buffer_
 
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
+}
+#endif
+
+// Scan of the ELEMENTS_PER_ITEM consecutive elements of one work item in private memory. Returns the sum of the elements.
+inline T ScanPrivate(__global T* buffer_a, uint32_t first_index, uint32_t num_elements, T* private_array)
+{
+	T sum = IDENTITY;
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = first_index + k;
+#ifndef SCAN_INCLUSIVE
+		private_array[k] = sum;
+#endif
+		sum = APPLY(sum, index < num_elements ? LOAD_TRANSFORM(buffer_a[ELEMENT_INDEX(index)]) : IDENTITY);
+#ifdef SCAN_INCLUSIVE
+		private_array[k] = sum;
+#endif
+	}
 
-	// write resulting buffer_b
-	buffer_b[global_id] = local_array[local_id];
+	return sum;
+}
+
+// is_final: the results are final and go through the store transform, otherwise CalcE completes them
+inline void WritePrivate(__global T* buffer_b, uint32_t first_index, uint32_t num_elements, T* private_array, T prefix, bool is_final)
+{
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = first_index + k;
+		if (index < num_elements)
+		{
+			T result = APPLY(prefix, private_array[k]);
+			buffer_b[ELEMENT_INDEX(index)] = is_final ? STORE_TRANSFORM(result) : result;
+		}
+	}
+}
+
+// Scans one tile of TILE_SIZE elements. Every work item scans ELEMENTS_PER_ITEM elements sequentially, only their sums go through the local tree.
+// Elements behind num_elements are treated as the identity. carry_in is combined with every result, so it's only set if there is a single tile.
+__kernel void PrefixSum256(__global T* buffer_a, __global T* buffer_b, __global T* buffer_c, __private uint32_t num_elements, __private T carry_in)
+{
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+	uint32_t first_index = group_id * TILE_SIZE + local_id * ELEMENTS_PER_ITEM;
+
+	__local T local_array[LOCAL_ARRAY_SIZE];
+	T private_array[ELEMENTS_PER_ITEM];
+
+	// scan own elements and copy their sum to local memory
+	T private_sum = ScanPrivate(buffer_a, first_index, num_elements, private_array);
+	local_array[LOCAL_INDEX(local_id)] = private_sum;
 	barrier(CLK_LOCAL_MEM_FENCE);
 
+	ScanLocal(local_array, local_id);
+
+	// write resulting buffer_b
+	T prefix = local_array[LOCAL_INDEX(local_id)];
+	// A single tile has no CalcE pass
+	WritePrivate(buffer_b, first_index, num_elements, private_array, APPLY(carry_in, prefix), get_num_groups(0) == 1);
+
 	// write resulting buffer_c
 	if(local_id == MAX_THREADS_PER_CU -1)
 	{
-		buffer_c[group_id] = buffer_a[global_id] + buffer_b[global_id];
+		buffer_c[group_id] = APPLY(prefix, private_sum);
 	}
 }
 
-__kernel void CalcE(__global int32_t* buffer_b, __global int32_t* buffer_d, __global int32_t* buffer_e, __private uint32_t num_elements)
+// Single-pass scan with decoupled look-back (Merrill & Garland). Every tile publishes its aggregate as soon as it is known and its
+// inclusive prefix once the look-back over its predecessors is done. tile_status and tile_counter have to be zeroed before each launch.
+// carry_in is the exclusive prefix of the first tile.
+__kernel void PrefixSumSinglePass(__global T* buffer_a, __global T* buffer_b, __global volatile uint32_t* tile_status,
+	__global volatile T* tile_aggregates, __global volatile T* tile_prefixes, __global uint32_t* tile_counter, __private uint32_t num_elements,
+	__private T carry_in)
+{
+	int32_t local_id = get_local_id(0);
+
+	__local T local_array[LOCAL_ARRAY_SIZE];
+	__local uint32_t tile_id;
+	__local T tile_exclusive_prefix;
+
+	// Tiles are numbered in the order the work groups start. Therefore every predecessor of a tile is already running and the look-back can't deadlock.
+	if (local_id == 0)
+	{
+		tile_id = atomic_inc(tile_counter);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	uint32_t first_index = tile_id * TILE_SIZE + local_id * ELEMENTS_PER_ITEM;
+	T private_array[ELEMENTS_PER_ITEM];
+
+	// scan own elements and copy their sum to local memory
+	T private_sum = ScanPrivate(buffer_a, first_index, num_elements, private_array);
+	local_array[LOCAL_INDEX(local_id)] = private_sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	ScanLocal(local_array, local_id);
+
+	if (local_id == MAX_THREADS_PER_CU - 1)
+	{
+		T aggregate = APPLY(local_array[LOCAL_INDEX(local_id)], private_sum);
+		T exclusive_prefix = tile_id == 0 ? carry_in : IDENTITY;
+
+		if (tile_id > 0)
+		{
+			tile_aggregates[tile_id] = aggregate;
+			write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+			atomic_xchg(&tile_status[tile_id], TILE_STATUS_AGGREGATE);
+
+			// Walk backwards until a tile with a known inclusive prefix is found
+			int32_t predecessor = tile_id - 1;
+			while (predecessor >= 0)
+			{
+				uint32_t status = atomic_or(&tile_status[predecessor], 0);
+				if (status == TILE_STATUS_INVALID)
+				{
+					continue;
+				}
+
+				read_mem_fence(CLK_GLOBAL_MEM_FENCE);
+				if (status == TILE_STATUS_PREFIX)
+				{
+					exclusive_prefix = APPLY(tile_prefixes[predecessor], exclusive_prefix);
+					break;
+				}
+
+				exclusive_prefix = APPLY(tile_aggregates[predecessor], exclusive_prefix);
+				--predecessor;
+			}
+		}
+
+		tile_prefixes[tile_id] = APPLY(exclusive_prefix, aggregate);
+		write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+		atomic_xchg(&tile_status[tile_id], TILE_STATUS_PREFIX);
+
+		tile_exclusive_prefix = exclusive_prefix;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	WritePrivate(buffer_b, first_index, num_elements, private_array, APPLY(tile_exclusive_prefix, local_array[LOCAL_INDEX(local_id)]), true);
+}
+
+// Adds the scanned sum of its tile (buffer_d) to every element of a tile. Each work item handles ELEMENTS_PER_ITEM elements, strided by the
+// work group size so neighbouring work items touch neighbouring elements.
+__kernel void CalcE(__global T* buffer_b, __global T* buffer_d, __global T* buffer_e, __private uint32_t num_elements)
+{
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+	uint32_t local_size = get_local_size(0);
+	uint32_t tile_offset = group_id * local_size * ELEMENTS_PER_ITEM;
+	T tile_prefix = buffer_d[group_id];
+
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = tile_offset + k * local_size + local_id;
+		if (index < num_elements)
+		{
+			buffer_e[ELEMENT_INDEX(index)] = STORE_TRANSFORM(APPLY(tile_prefix, buffer_b[ELEMENT_INDEX(index)]));
+		}
+	}
+}
+
+// Scans many independent arrays packed into buffer_a in one launch, one work group per array. buffer_offsets holds the first element of every
+// array followed by the total number of elements. The work group walks over the tiles of its array and carries the total of the tiles before,
+// so there are no sub array sums and no further launches. carry_in starts every array, reverse scans every array from its end.
+__kernel void PrefixSumBatched(__global T* buffer_a, __global T* buffer_b, __global uint32_t* buffer_offsets, __private T carry_in)
 {
-	int32_t global_id = get_global_id(0);
 	int32_t local_id = get_local_id(0);
 	int32_t group_id = get_group_id(0);
+	uint32_t array_offset = buffer_offsets[group_id];
+	uint32_t num_elements = buffer_offsets[group_id + 1] - array_offset;
+
+	__local T local_array[LOCAL_ARRAY_SIZE];
+	T private_array[ELEMENTS_PER_ITEM];
+	T carry = carry_in;
+
+	for (uint32_t tile_offset = 0; tile_offset < num_elements; tile_offset += TILE_SIZE)
+	{
+		uint32_t first_index = tile_offset + local_id * ELEMENTS_PER_ITEM;
+
+		// scan own elements and copy their sum to local memory
+		T private_sum = ScanPrivate(buffer_a + array_offset, first_index, num_elements, private_array);
+		local_array[LOCAL_INDEX(local_id)] = private_sum;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		ScanLocal(local_array, local_id);
+
+		T prefix = local_array[LOCAL_INDEX(local_id)];
+		WritePrivate(buffer_b + array_offset, first_index, num_elements, private_array, APPLY(carry, prefix), true);
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// The last work item publishes the total of the tile for the carry of the next one
+		if (local_id == MAX_THREADS_PER_CU - 1)
+		{
+			local_array[LOCAL_INDEX(0)] = APPLY(prefix, private_sum);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		carry = APPLY(carry, local_array[LOCAL_INDEX(0)]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+// Inclusive scan of MAX_THREADS_PER_CU (flag, value) pairs in local memory (Hillis & Steele). A set flag starts a new segment, so
+// (flag_1, value_1) op (flag_2, value_2) = (flag_1 | flag_2, flag_2 ? value_2 : value_1 op value_2).
+void ScanLocalSegmented(__local T* local_values, __local uint32_t* local_flags, int32_t local_id)
+{
+	for (int32_t offset = 1; offset < MAX_THREADS_PER_CU; offset <<= 1)
+	{
+		T value = local_values[local_id];
+		uint32_t flag = local_flags[local_id];
+		if (local_id >= offset)
+		{
+			if (!flag)
+			{
+				value = APPLY(local_values[local_id - offset], value);
+			}
+			flag |= local_flags[local_id - offset];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		local_values[local_id] = value;
+		local_flags[local_id] = flag;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+// Segmented scan of one tile of TILE_SIZE (flag, value) pairs. buffer_c/buffer_fc receive the total pair of every tile.
+// On the top level (top_level != 0) every segment starts at the identity and buffer_fb[i] is set if a segment starts at or before i in the tile.
+// On the levels below the results are plain exclusive pair scans and buffer_fb[i] is set if a segment starts before i in the tile.
+// Results with a cleared flag still need the prefix of their tile, see SegmentedCalcE.
+__kernel void SegmentedPrefixSum256(__global T* buffer_a, __global uint32_t* buffer_fa, __global T* buffer_b, __global uint32_t* buffer_fb,
+	__global T* buffer_c, __global uint32_t* buffer_fc, __private uint32_t num_elements, __private uint32_t top_level)
+{
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+	uint32_t first_index = group_id * TILE_SIZE + local_id * ELEMENTS_PER_ITEM;
+
+	__local T local_values[MAX_THREADS_PER_CU];
+	__local uint32_t local_flags[MAX_THREADS_PER_CU];
+
+	// reduce own elements and copy their total to local memory
+	T item_value = IDENTITY;
+	uint32_t item_flag = 0;
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = first_index + k;
+		if (index < num_elements)
+		{
+			uint32_t flag = buffer_fa[index];
+			item_value = flag ? buffer_a[index] : APPLY(item_value, buffer_a[index]);
+			item_flag |= flag;
+		}
+	}
+	local_values[local_id] = item_value;
+	local_flags[local_id] = item_flag;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	ScanLocalSegmented(local_values, local_flags, local_id);
+
+	// exclusive prefix of own elements within the tile
+	T running_value = local_id > 0 ? local_values[local_id - 1] : IDENTITY;
+	uint32_t running_flag = local_id > 0 ? local_flags[local_id - 1] : 0;
+
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = first_index + k;
+		if (index < num_elements)
+		{
+			uint32_t flag = buffer_fa[index];
+			T inclusive_value = flag ? buffer_a[index] : APPLY(running_value, buffer_a[index]);
+
+			if (top_level)
+			{
+#ifdef SCAN_INCLUSIVE
+				buffer_b[index] = inclusive_value;
+#else
+				buffer_b[index] = flag ? IDENTITY : running_value;
+#endif
+				buffer_fb[index] = running_flag | flag;
+			}
+			else
+			{
+				buffer_b[index] = running_value;
+				buffer_fb[index] = running_flag;
+			}
+
+			running_value = inclusive_value;
+			running_flag |= flag;
+		}
+	}
+
+	// write resulting buffer_c & buffer_fc
+	if (local_id == MAX_THREADS_PER_CU - 1)
+	{
+		buffer_c[group_id] = local_values[local_id];
+		buffer_fc[group_id] = local_flags[local_id];
+	}
+}
+
+// Combines the scanned prefix of its tile (buffer_d) with every result of the tile that isn't preceded by a segment start in the tile
+__kernel void SegmentedCalcE(__global T* buffer_b, __global uint32_t* buffer_fb, __global T* buffer_d, __private uint32_t num_elements)
+{
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+	uint32_t local_size = get_local_size(0);
+	uint32_t tile_offset = group_id * local_size * ELEMENTS_PER_ITEM;
+	T tile_prefix = buffer_d[group_id];
+
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = tile_offset + k * local_size + local_id;
+		if (index < num_elements && !buffer_fb[index])
+		{
+			buffer_b[index] = APPLY(tile_prefix, buffer_b[index]);
+		}
+	}
+}
+
+// Sets the head flag of the first element of every segment. buffer_flags has to be zeroed before.
+__kernel void SegmentHeadFlags(__global uint32_t* buffer_offsets, __global uint32_t* buffer_flags, __private uint32_t num_segments, __private uint32_t num_elements)
+{
+	uint32_t global_id = get_global_id(0);
+
+	if (global_id < num_segments && buffer_offsets[global_id] < num_elements)
+	{
+		buffer_flags[buffer_offsets[global_id]] = 1;
+	}
+}
+
+// Tree reduction of the values of a work group in local memory, returns the result in every work item
+inline T WorkGroupReduce(T value, __local T* local_array)
+{
+	int32_t local_id = get_local_id(0);
+
+	local_array[local_id] = value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int32_t stride = MAX_THREADS_PER_CU / 2; stride > 0; stride >>= 1)
+	{
+		if (local_id < stride)
+		{
+			local_array[local_id] = APPLY(local_array[local_id], local_array[local_id + stride]);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	return local_array[0];
+}
+
+// Reduces num_elements elements to one partial result per work group. Every work item combines a grid stride of the input in registers,
+// so the number of work groups is independent of the input size. A second launch with a single work group reduces the partial results.
+__kernel void Reduce(__global T* buffer_in, __global T* buffer_out, __private uint32_t num_elements)
+{
+	__local T local_array[MAX_THREADS_PER_CU];
+
+	T value = IDENTITY;
+	for (uint32_t i = get_global_id(0); i < num_elements; i += get_global_size(0))
+	{
+		value = APPLY(value, buffer_in[i]);
+	}
+
+	value = WorkGroupReduce(value, local_array);
+	if (get_local_id(0) == 0)
+	{
+		buffer_out[get_group_id(0)] = value;
+	}
+}
+
+#if OP == OP_MAX || OP == OP_MIN
+#if OP == OP_MAX
+#define ARG_BETTER(value_a, index_a, value_b, index_b) ((value_a) > (value_b) || ((value_a) == (value_b) && (index_a) < (index_b)))
+#else
+#define ARG_BETTER(value_a, index_a, value_b, index_b) ((value_a) < (value_b) || ((value_a) == (value_b) && (index_a) < (index_b)))
+#endif
+
+// Same as Reduce for argmax/argmin: the result is the value and the index of its first occurrence.
+// The first launch reads indices from the position in buffer_in (buffer_indices_in is unused), the second one reads the partial indices.
+__kernel void ArgReduce(__global T* buffer_in, __global uint32_t* buffer_indices_in, __global T* buffer_out, __global uint32_t* buffer_indices_out,
+	__private uint32_t num_elements, __private uint32_t partial_input)
+{
+	__local T local_values[MAX_THREADS_PER_CU];
+	__local uint32_t local_indices[MAX_THREADS_PER_CU];
+
+	int32_t local_id = get_local_id(0);
+
+	// 1. Grid stride in registers
+	T value = IDENTITY;
+	uint32_t index = UINT_MAX;
+	for (uint32_t i = get_global_id(0); i < num_elements; i += get_global_size(0))
+	{
+		T candidate = buffer_in[i];
+		uint32_t candidate_index = partial_input ? buffer_indices_in[i] : i;
+		if (ARG_BETTER(candidate, candidate_index, value, index))
+		{
+			value = candidate;
+			index = candidate_index;
+		}
+	}
+
+	// 2. Tree over the work group
+	local_values[local_id] = value;
+	local_indices[local_id] = index;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int32_t stride = MAX_THREADS_PER_CU / 2; stride > 0; stride >>= 1)
+	{
+		if (local_id < stride && ARG_BETTER(local_values[local_id + stride], local_indices[local_id + stride], local_values[local_id], local_indices[local_id]))
+		{
+			local_values[local_id] = local_values[local_id + stride];
+			local_indices[local_id] = local_indices[local_id + stride];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
 
-	if (global_id < num_elements)
+	if (local_id == 0)
 	{
-		buffer_e[global_id] = buffer_b[global_id] + buffer_d[group_id];
+		buffer_out[get_group_id(0)] = local_values[0];
+		buffer_indices_out[get_group_id(0)] = local_indices[0];
 	}
 }
+#endif
@@ -0,0 +1,177 @@
+// Typedefs for better comparison of host and device types
+typedef int					int32_t;
+typedef unsigned int		uint32_t;
+
+// Digit width and tile configuration, can be overridden with build options, e.g. "-DRADIX_BITS=8 -DELEMENTS_PER_ITEM=4"
+#ifndef RADIX_BITS
+#define RADIX_BITS 4
+#endif
+
+#ifndef WORK_GROUP_SIZE
+#define WORK_GROUP_SIZE 256
+#endif
+
+#ifndef ELEMENTS_PER_ITEM
+#define ELEMENTS_PER_ITEM 4
+#endif
+
+#define RADIX (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX - 1)
+#define TILE_SIZE (WORK_GROUP_SIZE * ELEMENTS_PER_ITEM)
+#define DIGIT(key, shift) (((key) >> (shift)) & RADIX_MASK)
+
+// Padding keys of the last tile. They sort behind every valid key of the tile and are never written.
+#define KEY_PADDING 0xFFFFFFFF
+
+// Exclusive scan of one value per work item (Hillis-Steele). total receives the sum of all values.
+inline uint32_t WorkGroupExclusiveScan(uint32_t value, __local uint32_t* local_sums, uint32_t* total)
+{
+	int32_t local_id = get_local_id(0);
+
+	local_sums[local_id] = value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int32_t offset = 1; offset < WORK_GROUP_SIZE; offset <<= 1)
+	{
+		uint32_t addend = local_id >= offset ? local_sums[local_id - offset] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		local_sums[local_id] += addend;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	uint32_t inclusive = local_sums[local_id];
+	*total = local_sums[WORK_GROUP_SIZE - 1];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	return inclusive - value;
+}
+
+// Counts the digits of one tile. The histograms are stored digit major (histograms[digit * num_groups + group]),
+// so their exclusive scan is the global start of every digit of every tile.
+__kernel void RadixHistogram(__global uint32_t* buffer_keys, __global uint32_t* buffer_histograms, __private uint32_t num_elements, __private uint32_t shift)
+{
+	__local uint32_t local_histogram[RADIX];
+
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+	uint32_t num_groups = get_num_groups(0);
+	uint32_t tile_offset = group_id * TILE_SIZE;
+
+	for (int32_t digit = local_id; digit < RADIX; digit += WORK_GROUP_SIZE)
+	{
+		local_histogram[digit] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = tile_offset + k * WORK_GROUP_SIZE + local_id;
+		if (index < num_elements)
+		{
+			atomic_inc(&local_histogram[DIGIT(buffer_keys[index], shift)]);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int32_t digit = local_id; digit < RADIX; digit += WORK_GROUP_SIZE)
+	{
+		buffer_histograms[digit * num_groups + group_id] = local_histogram[digit];
+	}
+}
+
+// Stable scatter of one tile:
+// 1. the tile is sorted by the digit in local memory with RADIX_BITS stable 1-bit splits
+// 2. the start of every digit in the sorted tile is found
+// 3. every key goes to the global start of its digit in this tile (scanned histogram) plus its rank among the keys of its digit
+// Values are moved along with their keys if RADIX_KEY_VALUE is defined.
+__kernel void RadixScatter(__global uint32_t* buffer_keys_in, __global uint32_t* buffer_values_in, __global uint32_t* buffer_keys_out, __global uint32_t* buffer_values_out,
+	__global uint32_t* buffer_offsets, __private uint32_t num_elements, __private uint32_t shift)
+{
+	__local uint32_t local_keys[TILE_SIZE];
+#ifdef RADIX_KEY_VALUE
+	__local uint32_t local_values[TILE_SIZE];
+#endif
+	__local uint32_t local_sums[WORK_GROUP_SIZE];
+	__local uint32_t local_digit_start[RADIX];
+
+	int32_t local_id = get_local_id(0);
+	int32_t group_id = get_group_id(0);
+	uint32_t num_groups = get_num_groups(0);
+	uint32_t tile_offset = group_id * TILE_SIZE;
+
+	// Every work item holds consecutive elements, so the order within the tile is kept by the splits
+	uint32_t item_offset = local_id * ELEMENTS_PER_ITEM;
+	uint32_t keys[ELEMENTS_PER_ITEM];
+#ifdef RADIX_KEY_VALUE
+	uint32_t values[ELEMENTS_PER_ITEM];
+#endif
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = tile_offset + item_offset + k;
+		keys[k] = index < num_elements ? buffer_keys_in[index] : KEY_PADDING;
+#ifdef RADIX_KEY_VALUE
+		values[k] = index < num_elements ? buffer_values_in[index] : 0;
+#endif
+	}
+
+	// 1. Sort the tile by the digit, one stable split per bit
+	for (int32_t bit = 0; bit < RADIX_BITS; ++bit)
+	{
+		uint32_t num_zeros = 0;
+		for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+		{
+			num_zeros += ((keys[k] >> (shift + bit)) & 1) ? 0 : 1;
+		}
+
+		uint32_t total_zeros = 0;
+		uint32_t zeros_before = WorkGroupExclusiveScan(num_zeros, local_sums, &total_zeros);
+		uint32_t ones_before = item_offset - zeros_before;
+
+		for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+		{
+			uint32_t position = ((keys[k] >> (shift + bit)) & 1) ? total_zeros + ones_before++ : zeros_before++;
+			local_keys[position] = keys[k];
+#ifdef RADIX_KEY_VALUE
+			local_values[position] = values[k];
+#endif
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+		{
+			keys[k] = local_keys[item_offset + k];
+#ifdef RADIX_KEY_VALUE
+			values[k] = local_values[item_offset + k];
+#endif
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	// 2. Start of every digit in the sorted tile
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = item_offset + k;
+		uint32_t digit = DIGIT(keys[k], shift);
+		if (index == 0 || DIGIT(local_keys[index - 1], shift) != digit)
+		{
+			local_digit_start[digit] = index;
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// 3. Scatter, the padding is at the end of the sorted tile
+	uint32_t num_valid = min((uint32_t)TILE_SIZE, num_elements - tile_offset);
+	for (int32_t k = 0; k < ELEMENTS_PER_ITEM; ++k)
+	{
+		uint32_t index = item_offset + k;
+		if (index < num_valid)
+		{
+			uint32_t digit = DIGIT(keys[k], shift);
+			uint32_t position = buffer_offsets[digit * num_groups + group_id] + index - local_digit_start[digit];
+			buffer_keys_out[position] = keys[k];
+#ifdef RADIX_KEY_VALUE
+			buffer_values_out[position] = values[k];
+#endif
+		}
+	}
+}
@@ -0,0 +1,48 @@
+// Typedefs for better comparison of host and device types
+typedef int					int32_t;
+typedef unsigned int		uint32_t;
+
+// Element type, set with a build option, e.g. "-DT=float"
+#ifndef T
+#define T int
+#endif
+
+#if defined(cl_khr_fp64)
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// bool Predicate(T x) is prepended to this file by StreamCompaction
+
+// Sets flags[i] to 1 if input[i] survives the filter, otherwise to 0
+__kernel void CompactFlags(__global T* buffer_input, __global uint32_t* buffer_flags, __private uint32_t num_elements)
+{
+	uint32_t global_id = get_global_id(0);
+
+	if (global_id < num_elements)
+	{
+		buffer_flags[global_id] = Predicate(buffer_input[global_id]) ? 1 : 0;
+	}
+}
+
+// Writes every surviving element to its position, the exclusive scan of the flags. The last work item writes the number of survivors.
+__kernel void CompactScatter(__global T* buffer_input, __global uint32_t* buffer_flags, __global uint32_t* buffer_positions, __global T* buffer_output,
+	__global uint32_t* buffer_count, __private uint32_t num_elements)
+{
+	uint32_t global_id = get_global_id(0);
+
+	if (global_id < num_elements)
+	{
+		uint32_t flag = buffer_flags[global_id];
+		uint32_t position = buffer_positions[global_id];
+
+		if (flag)
+		{
+			buffer_output[position] = buffer_input[global_id];
+		}
+
+		if (global_id == num_elements - 1)
+		{
+			buffer_count[0] = position + flag;
+		}
+	}
+}